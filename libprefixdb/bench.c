@@ -0,0 +1,587 @@
+// This file is part of the PrefixDB library
+// Copyright (c) 2014 Pierre-Yves Kerembellec <py.kerembellec@gmail.com>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <arpa/inet.h>
+#include <linux/perf_event.h>
+#include <libprefixdb.h>
+
+#define  BENCH_BATCH     (32)
+#define  BENCH_WARM      (1024)
+#define  BENCH_LOADS     (16)
+#define  BENCH_EVICT     (64 << 20)
+#define  BENCH_THREADS   (16)
+#define  BENCH_COUNTERS  (3)
+
+typedef struct
+{
+    const char *name;
+    uint32_t   count;
+    uint32_t   *addresses;
+    uint8_t    *lengths;
+} BENCH_DATASET;
+
+typedef struct
+{
+    const char *dataset, *label;
+    uint32_t   searches, threads[BENCH_THREADS], threads_count;
+    int        json;
+} BENCH_CONTEXT;
+
+typedef struct
+{
+    PREFIXDB          *pfdb;
+    pthread_barrier_t *barrier;
+    uint32_t          *hits, *misses, keys, offset, samples_count;
+    uint64_t          counters[BENCH_COUNTERS];
+    double            *samples;
+    int               counting;
+} __attribute__((aligned(64))) BENCH_THREAD;
+
+static uint64_t bench_state = 0x9e3779b97f4a7c15ULL;
+
+// xorshift64*, so that datasets and keys are identical from one run (and one library version) to the next
+static uint32_t bench_random()
+{
+    bench_state ^= bench_state >> 12;
+    bench_state ^= bench_state << 25;
+    bench_state ^= bench_state >> 27;
+    return (uint32_t)((bench_state * 0x2545f4914f6cdd1dULL) >> 32);
+}
+
+static uint32_t bench_unicast()
+{
+    return (((bench_random() % 223) + 1) << 24) | (bench_random() & 0x00ffffff);
+}
+
+static uint64_t bench_clock()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t)now.tv_sec * 1000000000) + now.tv_nsec;
+}
+
+static int bench_compare(const void *first, const void *second)
+{
+    return *(double *)first < *(double *)second ? -1 : *(double *)first > *(double *)second ? 1 : 0;
+}
+
+static void bench_report(BENCH_CONTEXT *context, const char *benchmark, uint32_t ops, uint64_t elapsed, double *samples, uint32_t count)
+{
+    double p50 = 0, p99 = 0, p999 = 0;
+
+    if (count)
+    {
+        qsort(samples, count, sizeof(double), bench_compare);
+        p50  = samples[(uint32_t)(count * 0.5)];
+        p99  = samples[(uint32_t)(count * 0.99)];
+        p999 = samples[(uint32_t)(count * 0.999)];
+    }
+    if (context->json)
+    {
+        printf("{\"label\":\"%s\",\"dataset\":\"%s\",\"benchmark\":\"%s\",\"ops\":%u,\"ns_op\":%.2f,\"p50\":%.2f,\"p99\":%.2f,\"p999\":%.2f}\n",
+               context->label, context->dataset, benchmark, ops, ops ? (double)elapsed / ops : 0, p50, p99, p999);
+    }
+    else
+    {
+        printf("%-8s  %-22s  %9u  %10.2f  %10.2f  %10.2f  %10.2f\n",
+               context->dataset, benchmark, ops, ops ? (double)elapsed / ops : 0, p50, p99, p999);
+    }
+    fflush(stdout);
+}
+
+// aggregate throughput over the wall time of all threads, per-lookup latencies and hardware counters
+static void bench_report_threads(BENCH_CONTEXT *context, const char *benchmark, uint32_t threads, uint64_t ops, uint64_t wall,
+                                 double *samples, uint32_t count, uint64_t *counters)
+{
+    double p50 = 0, p99 = 0, p999 = 0;
+
+    if (count)
+    {
+        qsort(samples, count, sizeof(double), bench_compare);
+        p50  = samples[(uint32_t)(count * 0.5)];
+        p99  = samples[(uint32_t)(count * 0.99)];
+        p999 = samples[(uint32_t)(count * 0.999)];
+    }
+    if (context->json)
+    {
+        printf("{\"label\":\"%s\",\"dataset\":\"%s\",\"benchmark\":\"%s\",\"threads\":%u,\"ops\":%lu,\"ops_s\":%.0f,"
+               "\"p50\":%.2f,\"p99\":%.2f,\"p999\":%.2f", context->label, context->dataset, benchmark, threads,
+               (unsigned long)ops, (double)ops * 1000000000 / wall, p50, p99, p999);
+        if (counters)
+        {
+            printf(",\"instructions_op\":%.2f,\"cache_misses_op\":%.4f,\"dtlb_misses_op\":%.4f",
+                   (double)counters[0] / ops, (double)counters[1] / ops, (double)counters[2] / ops);
+        }
+        printf("}\n");
+    }
+    else
+    {
+        printf("%-8s  %-22s  %9lu  %10.2f  %10.2f  %10.2f  %10.2f", context->dataset, benchmark, (unsigned long)ops,
+               (double)ops * 1000000000 / wall / 1000000, p50, p99, p999);
+        if (counters)
+        {
+            printf("  %8.2f ins  %6.4f llc  %6.4f dtlb", (double)counters[0] / ops, (double)counters[1] / ops, (double)counters[2] / ops);
+        }
+        printf("\n");
+    }
+    fflush(stdout);
+}
+
+// datasets ----------------------------------------------------------------------------------------------------------------
+static void bench_dataset_add(BENCH_DATASET *dataset, uint32_t address, uint8_t length)
+{
+    dataset->addresses[dataset->count] = address & (0xffffffff << (32 - length));
+    dataset->lengths[dataset->count]   = length;
+    dataset->count ++;
+}
+
+static int bench_dataset_allocate(BENCH_DATASET *dataset, const char *name, uint32_t count)
+{
+    dataset->name      = name;
+    dataset->count     = 0;
+    dataset->addresses = (uint32_t *)malloc(count * sizeof(uint32_t));
+    dataset->lengths   = (uint8_t *)malloc(count);
+    return dataset->addresses && dataset->lengths ? 0 : -1;
+}
+
+// prefix lengths distribution of a full IPv4 BGP table (roughly 60% of /24, then /22, /23, /21, /20, ...)
+static int bench_dataset_bgp(BENCH_DATASET *dataset, uint32_t count)
+{
+    static const struct { uint8_t length; uint16_t weight; } distribution[] =
+    {
+        {24, 6000}, {23, 1000}, {22, 1200}, {21, 500}, {20, 450}, {19, 300}, {18, 150}, {17, 100}, {16, 130},
+        {15, 25}, {14, 20}, {13, 10}, {12, 8}, {11, 4}, {10, 2}, {9, 1}, {8, 1}, {0, 0}
+    };
+    uint32_t total = 0, target, index;
+
+    for (index = 0; distribution[index].length; index ++)
+    {
+        total += distribution[index].weight;
+    }
+    if (bench_dataset_allocate(dataset, "bgp", count) < 0)
+    {
+        return -1;
+    }
+    while (dataset->count < count)
+    {
+        target = bench_random() % total;
+        for (index = 0; target >= distribution[index].weight; index ++)
+        {
+            target -= distribution[index].weight;
+        }
+        bench_dataset_add(dataset, bench_unicast(), distribution[index].length);
+    }
+    return 0;
+}
+
+// /24 blocklist concentrated in a limited set of /16s (mostly hosting and residential ranges)
+static int bench_dataset_dense(BENCH_DATASET *dataset, uint32_t count)
+{
+    uint32_t blocks[2048], index;
+
+    for (index = 0; index < sizeof(blocks) / sizeof(uint32_t); index ++)
+    {
+        blocks[index] = bench_unicast() & 0xffff0000;
+    }
+    if (bench_dataset_allocate(dataset, "dense", count) < 0)
+    {
+        return -1;
+    }
+    while (dataset->count < count)
+    {
+        bench_dataset_add(dataset, blocks[bench_random() % (sizeof(blocks) / sizeof(uint32_t))] | (bench_random() & 0xff00), 24);
+    }
+    return 0;
+}
+
+// a few thousand scattered hosts and /24s
+static int bench_dataset_sparse(BENCH_DATASET *dataset, uint32_t count)
+{
+    if (bench_dataset_allocate(dataset, "sparse", count) < 0)
+    {
+        return -1;
+    }
+    while (dataset->count < count)
+    {
+        bench_dataset_add(dataset, bench_unicast(), (bench_random() % 10) < 7 ? 32 : 24);
+    }
+    return 0;
+}
+
+// benchmarks --------------------------------------------------------------------------------------------------------------
+// per-operation latencies are sampled over batches of BENCH_BATCH operations, to keep the clock overhead out of the figures
+#define  BENCH_RUN(operation) \
+    { \
+        uint64_t start, batch; \
+        uint32_t count, inner; \
+        start = bench_clock(); \
+        for (count = 0, samples_count = 0; count + BENCH_BATCH <= ops; count += BENCH_BATCH) \
+        { \
+            batch = bench_clock(); \
+            for (inner = count; inner < count + BENCH_BATCH; inner ++) \
+            { \
+                operation; \
+            } \
+            samples[samples_count ++] = (double)(bench_clock() - batch) / BENCH_BATCH; \
+        } \
+        for (inner = count; inner < ops; inner ++) \
+        { \
+            operation; \
+        } \
+        elapsed = bench_clock() - start; \
+    }
+
+static void bench_evict(uint8_t *buffer)
+{
+    uint32_t offset;
+
+    for (offset = 0; buffer && offset < BENCH_EVICT; offset += 64)
+    {
+        buffer[offset] ++;
+    }
+}
+
+// hardware counters (instructions, cache misses, dTLB load misses) for the calling thread, where perf_event_open is allowed
+static int bench_counters_open(int *handles)
+{
+    static const uint64_t configs[BENCH_COUNTERS][2] =
+    {
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+        {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    };
+    struct perf_event_attr attributes;
+    int                    index;
+
+    for (index = 0; index < BENCH_COUNTERS; index ++)
+    {
+        memset(&attributes, 0, sizeof(attributes));
+        attributes.size           = sizeof(attributes);
+        attributes.type           = configs[index][0];
+        attributes.config         = configs[index][1];
+        attributes.disabled       = 1;
+        attributes.exclude_kernel = 1;
+        attributes.exclude_hv     = 1;
+        if ((handles[index] = syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0)) < 0)
+        {
+            while (index --)
+            {
+                close(handles[index]);
+            }
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void *bench_thread(void *argument)
+{
+    BENCH_THREAD *thread = (BENCH_THREAD *)argument;
+    PREFIXDB     *pfdb = thread->pfdb;
+    uint64_t     elapsed;
+    uint32_t     ops = thread->keys, samples_count = 0, *hits = thread->hits, *misses = thread->misses, offset = thread->offset;
+    double       *samples = thread->samples;
+    int          handles[BENCH_COUNTERS], index;
+
+    thread->counting = bench_counters_open(handles);
+    pthread_barrier_wait(thread->barrier);
+    for (index = 0; thread->counting && index < BENCH_COUNTERS; index ++)
+    {
+        ioctl(handles[index], PERF_EVENT_IOC_RESET, 0);
+        ioctl(handles[index], PERF_EVENT_IOC_ENABLE, 0);
+    }
+    BENCH_RUN(prefixdb_search_binary(pfdb, (inner & 1) ? misses[(inner + offset) % ops] : hits[(inner + offset) % ops], NULL));
+    for (index = 0; thread->counting && index < BENCH_COUNTERS; index ++)
+    {
+        ioctl(handles[index], PERF_EVENT_IOC_DISABLE, 0);
+        if (read(handles[index], &(thread->counters[index]), sizeof(uint64_t)) != sizeof(uint64_t))
+        {
+            thread->counting = 0;
+        }
+        close(handles[index]);
+    }
+    thread->samples_count = samples_count;
+    return (void *)(uintptr_t)elapsed;
+}
+
+// N readers searching the same database concurrently, each over all keys from its own starting point
+static int bench_threads(BENCH_CONTEXT *context, const char *path, uint32_t *hits, uint32_t *misses, double *samples)
+{
+    PREFIXDB          *pfdb;
+    BENCH_THREAD      *threads;
+    pthread_t         handles[256];
+    pthread_barrier_t barrier;
+    uint64_t          start, wall, counters[BENCH_COUNTERS];
+    uint32_t          mode, count, index, samples_count, counting;
+    double            *merged;
+    char              benchmark[32];
+
+    if (!(merged = (double *)malloc(context->searches / BENCH_BATCH * 256 * sizeof(double))) ||
+        posix_memalign((void **)&threads, 64, 256 * sizeof(BENCH_THREAD)))
+    {
+        return 1;
+    }
+    if (!context->json)
+    {
+        printf("%-8s  %-22s  %9s  %10s  %10s  %10s  %10s  %s\n", "", "", "ops", "Mops/s", "p50", "p99", "p99.9", "per lookup");
+    }
+    for (mode = 0; mode < 2; mode ++)
+    {
+        if (!(pfdb = prefixdb_load_file(path, mode ? PREFIXDB_FLAGS_MMAP : PREFIXDB_FLAGS_COPY)))
+        {
+            return 1;
+        }
+        for (count = 0; count < context->threads_count; count ++)
+        {
+            pthread_barrier_init(&barrier, NULL, context->threads[count] + 1);
+            for (index = 0; index < context->threads[count]; index ++)
+            {
+                memset(&(threads[index]), 0, sizeof(BENCH_THREAD));
+                threads[index].pfdb    = pfdb;
+                threads[index].barrier = &barrier;
+                threads[index].hits    = hits;
+                threads[index].misses  = misses;
+                threads[index].keys    = context->searches;
+                threads[index].offset  = (context->searches / context->threads[count]) * index;
+                threads[index].samples = merged + ((context->searches / BENCH_BATCH) * index);
+                pthread_create(&(handles[index]), NULL, bench_thread, &(threads[index]));
+            }
+            pthread_barrier_wait(&barrier);
+            start = bench_clock();
+            for (index = 0; index < context->threads[count]; index ++)
+            {
+                pthread_join(handles[index], NULL);
+            }
+            wall = bench_clock() - start;
+            pthread_barrier_destroy(&barrier);
+
+            memset(counters, 0, sizeof(counters));
+            for (index = 0, samples_count = 0, counting = 1; index < context->threads[count]; index ++)
+            {
+                memcpy(samples + samples_count, threads[index].samples, threads[index].samples_count * sizeof(double));
+                samples_count += threads[index].samples_count;
+                counters[0]   += threads[index].counters[0];
+                counters[1]   += threads[index].counters[1];
+                counters[2]   += threads[index].counters[2];
+                counting      &= threads[index].counting;
+            }
+            sprintf(benchmark, "threads %u (%s)", context->threads[count], mode ? "mmap" : "copy");
+            bench_report_threads(context, benchmark, context->threads[count], context->searches * context->threads[count], wall,
+                                 samples, samples_count, counting ? counters : NULL);
+        }
+        prefixdb_free(&pfdb);
+    }
+    free(merged);
+    free(threads);
+    return 0;
+}
+
+static int bench_dataset(BENCH_CONTEXT *context, BENCH_DATASET *dataset)
+{
+    PREFIXDB *pfdb;
+    uint64_t elapsed;
+    uint32_t *hits, *misses, *warm, ops, index, samples_count = 0, matched = 0, address;
+    uint8_t  *evict;
+    double   *samples;
+    char     path[] = "/tmp/prefixdb-bench-XXXXXX", (*strings)[16];
+    int      handle, status = 0, tries;
+
+    ops     = context->searches;
+    hits    = (uint32_t *)malloc(ops * sizeof(uint32_t));
+    misses  = (uint32_t *)malloc(ops * sizeof(uint32_t));
+    warm    = (uint32_t *)malloc(ops * sizeof(uint32_t));
+    strings = malloc(ops * sizeof(*strings));
+    samples = (double *)malloc(((ops > dataset->count ? ops : dataset->count) / BENCH_BATCH + 1) * sizeof(double));
+    evict   = (uint8_t *)calloc(1, BENCH_EVICT);
+    if (!hits || !misses || !warm || !strings || !samples || (handle = mkstemp(path)) < 0)
+    {
+        fprintf(stderr, "cannot allocate benchmark resources\n");
+        return 1;
+    }
+    close(handle);
+    context->dataset = dataset->name;
+    if (!context->json)
+    {
+        printf("%-8s  %-22s  %9s  %10s  %10s  %10s  %10s\n", "dataset", "benchmark", "ops", "ns/op", "p50", "p99", "p99.9");
+    }
+
+    // build
+    if (!(pfdb = prefixdb_allocate()))
+    {
+        return 1;
+    }
+    ops = dataset->count;
+    BENCH_RUN(status |= prefixdb_add_binary(pfdb, dataset->addresses[inner], dataset->lengths[inner], NULL));
+    bench_report(context, "add", ops, elapsed, samples, samples_count);
+    elapsed = bench_clock();
+    status |= prefixdb_save_file(pfdb, path);
+    bench_report(context, "save", 1, bench_clock() - elapsed, NULL, 0);
+    prefixdb_free(&pfdb);
+
+    // loads
+    for (index = 0; index < 2; index ++)
+    {
+        for (ops = 0; ops < BENCH_LOADS; ops ++)
+        {
+            elapsed = bench_clock();
+            pfdb    = prefixdb_load_file(path, index ? PREFIXDB_FLAGS_MMAP : PREFIXDB_FLAGS_COPY);
+            samples[ops] = (double)(bench_clock() - elapsed);
+            status |= pfdb ? 0 : 1;
+            prefixdb_free(&pfdb);
+        }
+        for (ops = 0, elapsed = 0; ops < BENCH_LOADS; ops ++)
+        {
+            elapsed += (uint64_t)samples[ops];
+        }
+        bench_report(context, index ? "load (mmap)" : "load (copy)", BENCH_LOADS, elapsed, samples, BENCH_LOADS);
+    }
+    if (status || !(pfdb = prefixdb_load_file(path, PREFIXDB_FLAGS_COPY)))
+    {
+        fprintf(stderr, "cannot build or load the %s dataset\n", dataset->name);
+        return 1;
+    }
+
+    // keys (pre-generated, hits inside stored prefixes, misses outside of any)
+    ops = context->searches;
+    for (index = 0; index < ops; index ++)
+    {
+        address     = bench_random() % dataset->count;
+        hits[index] = dataset->addresses[address] | (dataset->lengths[address] < 32 ? bench_random() & (0xffffffff >> dataset->lengths[address]) : 0);
+        tries       = 64;
+        do
+        {
+            misses[index] = bench_unicast();
+        } while (prefixdb_search_binary(pfdb, misses[index], NULL) != PREFIXDB_ERROR_NOTFOUND && -- tries);
+        warm[index] = hits[index % BENCH_WARM];
+        address     = htonl(hits[index]);
+        inet_ntop(AF_INET, &address, strings[index], sizeof(*strings));
+    }
+
+    // searches (cold runs go through a large keys set after evicting the CPU caches, warm runs loop over a few keys)
+    bench_evict(evict);
+    BENCH_RUN(matched += prefixdb_search_binary(pfdb, hits[inner], NULL) == PREFIXDB_ERROR_OK);
+    bench_report(context, "search hit (cold)", ops, elapsed, samples, samples_count);
+    BENCH_RUN(matched += prefixdb_search_binary(pfdb, warm[inner], NULL) == PREFIXDB_ERROR_OK);
+    bench_report(context, "search hit (warm)", ops, elapsed, samples, samples_count);
+    bench_evict(evict);
+    BENCH_RUN(prefixdb_search_binary(pfdb, misses[inner], NULL));
+    bench_report(context, "search miss (cold)", ops, elapsed, samples, samples_count);
+    BENCH_RUN(prefixdb_search_binary(pfdb, misses[inner % BENCH_WARM], NULL));
+    bench_report(context, "search miss (warm)", ops, elapsed, samples, samples_count);
+    bench_evict(evict);
+    BENCH_RUN(matched += prefixdb_search_string(pfdb, strings[inner], NULL) == PREFIXDB_ERROR_OK);
+    bench_report(context, "search string (cold)", ops, elapsed, samples, samples_count);
+    BENCH_RUN(matched += prefixdb_search_string(pfdb, strings[inner % BENCH_WARM], NULL) == PREFIXDB_ERROR_OK);
+    bench_report(context, "search string (warm)", ops, elapsed, samples, samples_count);
+    prefixdb_free(&pfdb);
+
+    // first searches on a freshly mapped database (including page faults)
+    if (!(pfdb = prefixdb_load_file(path, PREFIXDB_FLAGS_MMAP)))
+    {
+        return 1;
+    }
+    BENCH_RUN(matched += prefixdb_search_binary(pfdb, hits[inner], NULL) == PREFIXDB_ERROR_OK);
+    bench_report(context, "search hit (mmap)", ops, elapsed, samples, samples_count);
+    prefixdb_free(&pfdb);
+
+    // concurrent readers (throughput in Mops/s instead of ns/op)
+    if (context->threads_count)
+    {
+        free(samples);
+        if (!(samples = (double *)malloc(ops / BENCH_BATCH * 256 * sizeof(double))) || bench_threads(context, path, hits, misses, samples))
+        {
+            fprintf(stderr, "cannot run the concurrent searches on the %s dataset\n", dataset->name);
+            status = 1;
+        }
+    }
+
+    if (matched != ops * 5)
+    {
+        fprintf(stderr, "inconsistent search results on the %s dataset (%u matches instead of %u)\n", dataset->name, matched, ops * 5);
+        status = 1;
+    }
+    unlink(path);
+    free(dataset->addresses);
+    free(dataset->lengths);
+    free(hits);
+    free(misses);
+    free(warm);
+    free(strings);
+    free(samples);
+    free(evict);
+    return status;
+}
+
+static int bench_usage()
+{
+    fprintf
+    (
+        stderr,
+        "usage: prefixdb-bench [<options>]\n\n"
+        "-d <dataset>   run only the bgp, dense or sparse dataset (default: all)\n"
+        "-n <count>     number of searches per benchmark (default: 1000000)\n"
+        "-s <seed>      random generator seed (default: fixed)\n"
+        "-l <label>     label added to machine-readable results (default: none)\n"
+        "-j             emit results as JSON lines\n"
+        "-t <threads>   also run concurrent searches with these comma-separated threads counts (e.g. 1,2,4,8,16,32,64)\n"
+    );
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    BENCH_CONTEXT context = { NULL, "", 1000000, {0}, 0, 0 };
+    BENCH_DATASET dataset;
+    char          *only = NULL, *token;
+    int           option, status = 0;
+
+    while ((option = getopt(argc, argv, "d:n:s:l:t:jh")) != -1)
+    {
+        switch (option)
+        {
+            case 't':
+                for (token = strtok(optarg, ","); token && context.threads_count < BENCH_THREADS; token = strtok(NULL, ","))
+                {
+                    if ((context.threads[context.threads_count] = strtoul(token, NULL, 10)) < 1 || context.threads[context.threads_count] > 256)
+                    {
+                        return bench_usage();
+                    }
+                    context.threads_count ++;
+                }
+                break;
+            case 'd': only             = optarg; break;
+            case 'n': context.searches = strtoul(optarg, NULL, 10); break;
+            case 's': bench_state     ^= strtoull(optarg, NULL, 10); break;
+            case 'l': context.label    = optarg; break;
+            case 'j': context.json     = 1; break;
+            default:  return bench_usage();
+        }
+    }
+    if (context.searches < BENCH_WARM)
+    {
+        return bench_usage();
+    }
+    if (!only || !strcmp(only, "bgp"))
+    {
+        status |= bench_dataset_bgp(&dataset, 900000) < 0 ? 1 : bench_dataset(&context, &dataset);
+    }
+    if (!only || !strcmp(only, "dense"))
+    {
+        status |= bench_dataset_dense(&dataset, 300000) < 0 ? 1 : bench_dataset(&context, &dataset);
+    }
+    if (!only || !strcmp(only, "sparse"))
+    {
+        status |= bench_dataset_sparse(&dataset, 5000) < 0 ? 1 : bench_dataset(&context, &dataset);
+    }
+    return status;
+}
@@ -4,545 +4,3976 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <arpa/inet.h>
+#include <pthread.h>
 #include <libprefixdb.h>
 
-#define  PREFIXDB_LIBRARY_VERSION  (0x0101)
+#define  PREFIXDB_LIBRARY_VERSION  (0x0201)
+#define  PREFIXDB_SECTIONS_VERSION (0x0200)
+#define  PREFIXDB_PLAIN_VERSION    (0x0101)
+#define  PREFIXDB_TAGGED_VERSION   (0x0102)
 #define  PREFIXDB_MAGIC_MARKER     (0x50464442)
 #define  PREFIXDB_FLAGS_SERIALIZED (0x80)
+#define  PREFIXDB_FLAGS_OPTIONS    (PREFIXDB_FLAGS_PREFILTER | PREFIXDB_FLAGS_CACHE | PREFIXDB_FLAGS_METRICS | PREFIXDB_FLAGS_COUNTERS)
+#define  PREFIXDB_PREFILTER_LENGTH (16)
+#define  PREFIXDB_SHARDS           (64)
+#define  PREFIXDB_CACHELINE        (64)
+#define  PREFIXDB_CACHE_LENGTH     (12)
+#define  PREFIXDB_BATCH_SIZE       (16)
+#define  PREFIXDB_CHUNK_NODES      (4096)
+#define  PREFIXDB_FILE_BATCH       (65536)
+#define  PREFIXDB_HEADER_SIZE      (64)
+#define  PREFIXDB_PAGE_SIZE        (4096)
+#define  PREFIXDB_INDEX_LENGTH     (12)
+#define  PREFIXDB_SUMMARY_SIZE     ((4 * (2 + 33 + 33)) + 8)
+#define  PREFIXDB_SECTION_NODES    (1)
+#define  PREFIXDB_SECTION_VALUES   (2)
+#define  PREFIXDB_SECTION_INDEX    (3)
+#define  PREFIXDB_SECTION_SUMMARY  (4)
+#define  PREFIXDB_SECTION_CHECKSUM (5)
+#define  PREFIXDB_SECTION_SKIPS    (6)
+#define  PREFIXDB_SECTION_HASH     (7)
+#define  PREFIXDB_SECTION_INTERVALS (8)
+#define  PREFIXDB_SECTIONS         (9)
+#define  PREFIXDB_DELTA_MARKER     (0x50464444)
+#define  PREFIXDB_DELTA_VERSION    (0x0100)
+#define  PREFIXDB_DELTA_HEADER     (32)
+#define  PREFIXDB_DELTA_ENTRY      (13)
+#define  PREFIXDB_PREFIX_MASK(length) ((length) ? 0xffffffff << (32 - (length)) : 0)
+
+#define  PREFIXDB_ADD(counter, value) __atomic_fetch_add(&(counter), (value), __ATOMIC_RELAXED)
+#define  PREFIXDB_COUNT(counter)   PREFIXDB_ADD(counter, 1)
+#define  PREFIXDB_HIT(counter)     __atomic_fetch_add(&(counter), 1, __ATOMIC_RELAXED)
+#define  PREFIXDB_NO_SLOT          (0xffffffff)
+#define  PREFIXDB_HASH_MARKER      (0xffffffff)
 
 typedef struct __PREFIXDB_NODE
 {
     struct __PREFIXDB_NODE *down[2], *up;
+    uint64_t               tags;
     uint32_t               id, explored[2], flaggued;
 } _PREFIXDB_NODE;
 
+typedef struct __PREFIXDB_CHUNK
+{
+    struct __PREFIXDB_CHUNK *next;
+    _PREFIXDB_NODE          nodes[PREFIXDB_CHUNK_NODES];
+} _PREFIXDB_CHUNK;
+
+typedef struct
+{
+    uint64_t prefilter_checked, prefilter_rejected, cache_hits, cache_misses;
+} __attribute__((aligned(PREFIXDB_CACHELINE))) _PREFIXDB_SHARD;
+
+typedef struct
+{
+    PREFIXDBMETRICS metrics;
+} __attribute__((aligned(PREFIXDB_CACHELINE))) _PREFIXDB_METRICS;
+
+typedef struct
+{
+    uint32_t address, generation, value, slot;
+} _PREFIXDB_CACHE_ENTRY;
+
+typedef struct
+{
+    uint32_t key, value;
+} _PREFIXDB_SLOT;
+
+typedef struct
+{
+    _PREFIXDB_SLOT *slots;
+    uint32_t       size, counts[33], offsets[33];
+    uint8_t        count, lengths[33], tables[33], bits[33], stored;
+} _PREFIXDB_HASH;
+
+typedef struct
+{
+    uint32_t *bounds, *values, count, size;
+    uint8_t  stored;
+} _PREFIXDB_INTERVALS;
+
 typedef struct
 {
-    _PREFIXDB_NODE nodes;
-    uint32_t       version, nodes_count, data_size, pass;
-    uint8_t        *data, records_size, flags;
-    int            handle;
+    _PREFIXDB_NODE      nodes, *spare;
+    _PREFIXDB_CHUNK     *chunks;
+    _PREFIXDB_SHARD     *shards;
+    _PREFIXDB_METRICS   *metrics;
+    _PREFIXDB_HASH      *hash;
+    _PREFIXDB_INTERVALS *intervals;
+    uint64_t            *values, *counters;
+    uint32_t            version, nodes_count, values_count, skips_count, data_size, pass, generation, chunk_used, chunks_count;
+    uint32_t            lookup_size;
+    uint8_t             *data, *records, *skips, *index, *summary, *checksum, *lookup, *prefilter, records_size, flags, engine;
+    int                 handle;
 } _PREFIXDB;
 
-PREFIXDB *prefixdb_allocate()
+static uint32_t              prefixdb_threads, prefixdb_generations;
+static pthread_once_t        prefixdb_cache_once = PTHREAD_ONCE_INIT;
+static pthread_key_t         prefixdb_cache_key;
+static __thread int32_t      prefixdb_thread = -1;
+static __thread _PREFIXDB_CACHE_ENTRY *prefixdb_cache;
+
+// counters are spread over cache-line aligned shards handed out round-robin to threads as they first count, which keeps
+// most concurrent readers off each other's lines; ids are never recycled, so with more than PREFIXDB_SHARDS threads (or with
+// thread churn) shards end up shared, and every update is an atomic add
+static inline int32_t prefixdb_shard_index(void)
 {
-    return (PREFIXDB *)calloc(1, sizeof(_PREFIXDB));
+    if (prefixdb_thread < 0)
+    {
+        prefixdb_thread = __sync_fetch_and_add(&prefixdb_threads, 1) % PREFIXDB_SHARDS;
+    }
+    return prefixdb_thread;
 }
 
-PREFIXDB *prefixdb_load_binary(const uint8_t *data, uint32_t size, uint8_t flags)
+static inline _PREFIXDB_SHARD *prefixdb_shard(_PREFIXDB *db)
 {
-    _PREFIXDB *db;
-    uint32_t  nodes_count, version;
-    uint8_t   records_size;
+    return db->shards + prefixdb_shard_index();
+}
+
+static inline PREFIXDBMETRICS *prefixdb_metrics_shard(_PREFIXDB *db)
+{
+    return &(db->metrics[prefixdb_shard_index()].metrics);
+}
 
-    if (!data || size < 31 || memcmp(data + size - 31, "\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00", 16) ||
-        ntohl(*(uint32_t *)(data + size - 4)) != PREFIXDB_MAGIC_MARKER || ntohl(*(uint32_t *)(data + size - 8)) != size ||
-        (version = ntohs(*(uint16_t *)(data + size - 10))) > PREFIXDB_LIBRARY_VERSION ||
-        (nodes_count = ntohl(*(uint32_t *)(data + size - 14))) == 0xffffffff || (records_size = *(data + size - 15)) % 8 ||
-        (nodes_count * (records_size / 8) * 2) != (size - 31) || !(db = prefixdb_allocate()))
+static inline uint64_t prefixdb_clock(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t)now.tv_sec * 1000000000) + now.tv_nsec;
+}
+
+// log-linear latency histogram: exact below 8ns, then 4 buckets per power of 2 (up to ~68s)
+static void prefixdb_histogram_add(PREFIXDBHISTOGRAM *histogram, uint64_t value)
+{
+    uint32_t bucket = value, exponent;
+
+    if (value >= 8)
     {
-        return NULL;
+        exponent = 63 - __builtin_clzll(value);
+        bucket   = 8 + ((exponent - 3) * 4) + ((value >> (exponent - 2)) & 3);
+        if (bucket >= PREFIXDB_HISTOGRAM_SIZE)
+        {
+            bucket = PREFIXDB_HISTOGRAM_SIZE - 1;
+        }
     }
-    db->records_size = records_size / 8;
-    db->nodes_count  = nodes_count;
-    db->data_size    = size;
-    db->flags       |= PREFIXDB_FLAGS_SERIALIZED;
-    if (flags & PREFIXDB_FLAGS_COPY)
+    PREFIXDB_COUNT(histogram->count);
+    PREFIXDB_ADD(histogram->total, value);
+    PREFIXDB_COUNT(histogram->buckets[bucket]);
+}
+
+// each serialized image gets a process-wide unique generation, so that stale per-thread cache entries never match
+static void prefixdb_generation(_PREFIXDB *db)
+{
+    while (!(db->generation = __sync_add_and_fetch(&prefixdb_generations, 1)));
+}
+
+static void prefixdb_cache_release(void *cache)
+{
+    free(cache);
+}
+
+static void prefixdb_cache_initialize(void)
+{
+    pthread_key_create(&prefixdb_cache_key, prefixdb_cache_release);
+}
+
+static inline _PREFIXDB_CACHE_ENTRY *prefixdb_cache_entry(uint32_t address)
+{
+    if (!prefixdb_cache)
     {
-        db->flags |= PREFIXDB_FLAGS_COPY;
-        if (!(db->data = (uint8_t *)malloc(db->data_size)))
+        pthread_once(&prefixdb_cache_once, prefixdb_cache_initialize);
+        if (!(prefixdb_cache = (_PREFIXDB_CACHE_ENTRY *)calloc(1 << PREFIXDB_CACHE_LENGTH, sizeof(_PREFIXDB_CACHE_ENTRY))))
         {
-            prefixdb_free((PREFIXDB *)&db);
             return NULL;
         }
-        memcpy(db->data, data, size);
+        pthread_setspecific(prefixdb_cache_key, prefixdb_cache);
     }
-    else
+    return prefixdb_cache + ((address * 2654435761U) >> (32 - PREFIXDB_CACHE_LENGTH));
+}
+
+static inline uint32_t prefixdb_read_record(_PREFIXDB *db, uint8_t *precord)
+{
+    uint32_t value = 0;
+    uint8_t  count;
+
+    for (count = 0; count < db->records_size; count ++)
     {
-        db->data = (uint8_t *)data;
+        value = (value << 8) + *(precord + count);
     }
-    return db;
+    return value;
 }
 
-PREFIXDB *prefixdb_load_file(const char *path, uint8_t flags)
+// record values above the leaves ones reference skip entries, each replacing a chain of single-child nodes: the prefix of
+// the record found at the end of the chain (all of its bits must match the searched address), its length and the record
+static inline uint32_t prefixdb_skips_base(_PREFIXDB *db)
 {
-    _PREFIXDB   *db;
-    struct stat info;
-    uint32_t    nodes_count, version;
-    uint8_t     data[31], records_size;
-    int         handle;
+    return db->nodes_count + 16 + (db->values_count ? db->values_count : 1);
+}
+
+// lists mask of a leaf record value (plain databases only have the first list)
+static inline uint64_t prefixdb_value_tags(_PREFIXDB *db, uint32_t value)
+{
+    return (db->values && value - db->nodes_count - 16 < db->values_count) ? db->values[value - db->nodes_count - 16] : 1;
+}
+
+static inline int prefixdb_is_skip(_PREFIXDB *db, uint32_t value)
+{
+    return value >= prefixdb_skips_base(db);
+}
+
+static inline uint8_t *prefixdb_skip_entry(_PREFIXDB *db, uint32_t value)
+{
+    value -= prefixdb_skips_base(db);
+    return value < db->skips_count ? db->skips + (value * (db->records_size + 5)) : NULL;
+}
 
-    if (!path || stat(path, &info) < 0 || info.st_size < 31 || (handle = open(path, O_RDONLY)) < 0)
+// hit counters (PREFIXDB_FLAGS_COUNTERS) belong to the image, being reset whenever it is serialized again (lookups answered by
+// the build trie of a modified database are not counted), and are indexed by the record leaves are read from: node records
+// first, then the records ending skip entries
+static inline uint32_t prefixdb_counters_count(_PREFIXDB *db)
+{
+    return (db->nodes_count * 2) + db->skips_count;
+}
+
+static inline uint32_t prefixdb_skip_prefix(const uint8_t *entry)
+{
+    return ((uint32_t)entry[0] << 24) | ((uint32_t)entry[1] << 16) | ((uint32_t)entry[2] << 8) | entry[3];
+}
+
+// one dependent load of a lookup: follow the record of node *next for the address bit *bit, or check the skip entry *next;
+// returns -1 while the lookup goes on, its final status otherwise (*next then being the matched leaf record value)
+static inline int prefixdb_step(_PREFIXDB *db, uint32_t address, uint32_t *next, int8_t *bit)
+{
+    uint8_t *entry;
+
+    if (*next < db->nodes_count)
     {
-        return NULL;
+        if (*bit < 0)
+        {
+            return PREFIXDB_ERROR_PARAM;
+        }
+        *next = prefixdb_read_record(db, db->records + (*next * (db->records_size * 2)) + (((address >> *bit) & 1) ? db->records_size : 0));
+        (*bit) --;
+        return -1;
     }
-    if (lseek(handle, info.st_size - 31, SEEK_SET) != (info.st_size - 31) || read(handle, data, 31) != 31 ||
-        memcmp(data, "\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00", 16) ||
-        ntohl(*(uint32_t *)(data + 27)) != PREFIXDB_MAGIC_MARKER || ntohl(*(uint32_t *)(data + 23)) != info.st_size ||
-        (version = ntohs(*(uint16_t *)(data + 21))) > PREFIXDB_LIBRARY_VERSION ||
-        (nodes_count = ntohl(*(uint32_t *)(data + 17))) == 0xffffffff || (records_size = *(data + 16)) % 8 ||
-        (nodes_count * (records_size / 8) * 2) != (info.st_size - 31) || !(db = prefixdb_allocate()))
+    if (*next == db->nodes_count)
     {
-        close(handle);
-        return NULL;
+        return PREFIXDB_ERROR_NOTFOUND;
     }
-    db->records_size = records_size / 8;
-    db->nodes_count  = nodes_count;
-    db->data_size    = info.st_size;
-    db->flags       |= PREFIXDB_FLAGS_SERIALIZED;
-    if (flags & PREFIXDB_FLAGS_MMAP)
+    if (!prefixdb_is_skip(db, *next))
     {
-        db->flags |= PREFIXDB_FLAGS_MMAP;
-        db->handle = handle;
-        if ((db->data = (uint8_t *)mmap(NULL, db->data_size, PROT_READ, MAP_SHARED, db->handle, 0)) == MAP_FAILED)
+        return PREFIXDB_ERROR_OK;
+    }
+    if (!(entry = prefixdb_skip_entry(db, *next)) || entry[4] <= 31 - *bit || entry[4] > 32)
+    {
+        return PREFIXDB_ERROR_PARAM;
+    }
+    if ((address ^ prefixdb_skip_prefix(entry)) & PREFIXDB_PREFIX_MASK(entry[4]))
+    {
+        return PREFIXDB_ERROR_NOTFOUND;
+    }
+    *next = prefixdb_read_record(db, entry + 5);
+    *bit  = 31 - entry[4];
+    return -1;
+}
+
+static inline void prefixdb_prefetch(_PREFIXDB *db, uint32_t value)
+{
+    uint8_t *entry;
+
+    if (value < db->nodes_count)
+    {
+        __builtin_prefetch(db->records + (value * (db->records_size * 2)));
+    }
+    else if (prefixdb_is_skip(db, value) && (entry = prefixdb_skip_entry(db, value)))
+    {
+        __builtin_prefetch(entry);
+    }
+}
+
+typedef int (*_PREFIXDB_WALKER)(_PREFIXDB *, uint32_t, uint8_t, uint8_t, uint32_t, void *);
+
+static int prefixdb_walk(_PREFIXDB *db, uint32_t node, uint32_t address, uint8_t length, uint8_t depth, _PREFIXDB_WALKER walker, void *context);
+
+// expand the skip entry value found at prefix length: the siblings of its path are empty, and its record ends the path
+static int prefixdb_walk_skip(_PREFIXDB *db, uint32_t value, uint8_t length, uint8_t depth, _PREFIXDB_WALKER walker, void *context)
+{
+    uint32_t prefix, next;
+    uint8_t  *entry, end, current;
+    int      status;
+
+    if (!(entry = prefixdb_skip_entry(db, value)) || entry[4] <= length || entry[4] > 32)
+    {
+        return -1;
+    }
+    prefix = prefixdb_skip_prefix(entry) & PREFIXDB_PREFIX_MASK(entry[4]);
+    end    = entry[4];
+    next   = prefixdb_read_record(db, entry + 5);
+    for (current = length + 1; current <= end; current ++)
+    {
+        if ((prefix & ((uint32_t)1 << (32 - current))) &&
+            walker(db, prefix & PREFIXDB_PREFIX_MASK(current - 1), current, depth + 1, db->nodes_count, context) < 0)
         {
-            close(handle);
-            prefixdb_free((PREFIXDB *)&db);
-            return NULL;
+            return -1;
         }
     }
-    else
+    if ((status = walker(db, prefix, end, depth + 1, next, context)) < 0 ||
+        (status && next < db->nodes_count && end < 32 && prefixdb_walk(db, next, prefix, end, depth + 1, walker, context) < 0) ||
+        (status && prefixdb_is_skip(db, next) && prefixdb_walk_skip(db, next, end, depth + 1, walker, context) < 0))
     {
-        db->flags |= PREFIXDB_FLAGS_COPY;
-        lseek(handle, 0, SEEK_SET);
-        if (!(db->data = (uint8_t *)malloc(db->data_size)) || (read(handle, db->data, db->data_size) != db->data_size))
+        return -1;
+    }
+    for (current = end; current > length; current --)
+    {
+        if (!(prefix & ((uint32_t)1 << (32 - current))) &&
+            walker(db, (prefix & PREFIXDB_PREFIX_MASK(current - 1)) | ((uint32_t)1 << (32 - current)), current, depth + 1, db->nodes_count, context) < 0)
         {
-            close(handle);
-            if (db->data) free(db->data);
-            prefixdb_free((PREFIXDB *)&db);
-            return NULL;
+            return -1;
         }
-        close(handle);
     }
-    return db;
+    return 0;
 }
 
-static int prefixdb_free_down(_PREFIXDB_NODE *node)
+// depth-first walk of the serialized trie below node, calling back for each record with its prefix, the number of nodes
+// visited to reach it and its value; the callback returns 1 to descend below a node record, 0 to skip it and < 0 to abort
+// (skip records are expanded into the records of the chain they replace, ordered by address)
+static int prefixdb_walk(_PREFIXDB *db, uint32_t node, uint32_t address, uint8_t length, uint8_t depth, _PREFIXDB_WALKER walker, void *context)
 {
-    _PREFIXDB_NODE *pnode, *unode;
+    uint32_t next, prefix;
+    uint8_t  type;
+    int      status;
 
-    pnode = node;
-    while (1)
+    for (type = 0; type <= 1; type ++)
     {
-        while (pnode->down[0])
+        next   = prefixdb_read_record(db, db->records + (node * 2 * db->records_size) + (type ? db->records_size : 0));
+        prefix = address | ((uint32_t)type << (31 - length));
+        if ((status = walker(db, prefix, length + 1, depth + 1, next, context)) < 0 ||
+            (status && next < db->nodes_count && length < 31 && prefixdb_walk(db, next, prefix, length + 1, depth + 1, walker, context) < 0) ||
+            (status && prefixdb_is_skip(db, next) && prefixdb_walk_skip(db, next, length + 1, depth + 1, walker, context) < 0))
         {
-            pnode = pnode->down[0];
+            return -1;
         }
-        if (pnode->down[1])
+    }
+    return 0;
+}
+
+static int prefixdb_prefilter_fill(_PREFIXDB *db, uint32_t address, uint8_t length, uint8_t depth, uint32_t value, void *context)
+{
+    uint32_t first, count;
+
+    if (value == db->nodes_count)
+    {
+        return 0;
+    }
+    if ((value < db->nodes_count || prefixdb_is_skip(db, value)) && length < PREFIXDB_PREFILTER_LENGTH)
+    {
+        return 1;
+    }
+    // (records found past the prefilter length at the end of a skip entry only mark their own bit)
+    first = address >> (32 - PREFIXDB_PREFILTER_LENGTH);
+    for (count = 0; count < (length < PREFIXDB_PREFILTER_LENGTH ? 1 << (PREFIXDB_PREFILTER_LENGTH - length) : 1); count ++)
+    {
+        db->prefilter[(first + count) / 8] |= (1 << ((first + count) % 8));
+    }
+    return 0;
+}
+
+// hash engine (binary search on prefix lengths): one open-addressing table per distinct leaf length, holding the leaves of
+// that length and markers for the longer leaves whose binary search goes through it; leaves being disjoint, no shorter leaf
+// can match below a marker, so a lookup never backtracks and takes at most log2(lengths) + 1 probes (slots keys and values
+// are big-endian once built, so that the tables are used in place from the image hash section)
+static inline uint32_t prefixdb_hash_slot(uint32_t key, uint8_t bits)
+{
+    return ((uint64_t)key * 0x9e3779b97f4a7c15ULL) >> (64 - bits);
+}
+
+static int prefixdb_hash_count(_PREFIXDB *db, uint32_t address, uint8_t length, uint8_t depth, uint32_t value, void *context)
+{
+    if (value < db->nodes_count || prefixdb_is_skip(db, value))
+    {
+        return 1;
+    }
+    if (value > db->nodes_count)
+    {
+        ((_PREFIXDB_HASH *)context)->counts[length] ++;
+    }
+    return 0;
+}
+
+static void prefixdb_hash_insert(_PREFIXDB_HASH *hash, uint8_t table, uint32_t key, uint32_t value)
+{
+    _PREFIXDB_SLOT *slots = hash->slots + hash->offsets[table];
+    uint32_t       slot   = prefixdb_hash_slot(key, hash->bits[table]), mask = (1 << hash->bits[table]) - 1;
+
+    while (slots[slot].value && slots[slot].key != key)
+    {
+        slot = (slot + 1) & mask;
+    }
+    if (!slots[slot].value || value != PREFIXDB_HASH_MARKER)
+    {
+        slots[slot].key   = key;
+        slots[slot].value = value;
+    }
+}
+
+static int prefixdb_hash_fill(_PREFIXDB *db, uint32_t address, uint8_t length, uint8_t depth, uint32_t value, void *context)
+{
+    _PREFIXDB_HASH *hash = (_PREFIXDB_HASH *)context;
+    int8_t         low = 0, high = hash->count - 1, middle, target;
+
+    if (value < db->nodes_count || prefixdb_is_skip(db, value))
+    {
+        return 1;
+    }
+    if (value > db->nodes_count)
+    {
+        target = hash->tables[length];
+        while (low <= high && (middle = (low + high) / 2) != target)
         {
-            pnode = pnode->down[1];
-            continue;
+            if (middle < target)
+            {
+                prefixdb_hash_insert(hash, middle, address & PREFIXDB_PREFIX_MASK(hash->lengths[middle]), PREFIXDB_HASH_MARKER);
+                low = middle + 1;
+            }
+            else
+            {
+                high = middle - 1;
+            }
         }
-        if (pnode == node)
+        prefixdb_hash_insert(hash, target, address, value);
+    }
+    return 0;
+}
+
+static int prefixdb_hash_build(_PREFIXDB *db)
+{
+    _PREFIXDB_HASH *hash;
+    uint32_t       entries[33], size = 0;
+    int8_t         low, high, middle, target;
+    uint8_t        length;
+
+    if (!(hash = (_PREFIXDB_HASH *)calloc(1, sizeof(_PREFIXDB_HASH))))
+    {
+        return PREFIXDB_ERROR_MEMORY;
+    }
+    if (db->nodes_count)
+    {
+        prefixdb_walk(db, 0, 0, 0, 0, prefixdb_hash_count, hash);
+    }
+    for (length = 1; length <= 32; length ++)
+    {
+        if (hash->counts[length])
         {
-            break;
+            hash->tables[length]        = hash->count;
+            hash->lengths[hash->count]  = length;
+            entries[hash->count ++]     = hash->counts[length];
         }
-        unode = pnode->up;
-        unode->down[unode->down[0] == pnode ? 0 : 1] = NULL;
-        free(pnode);
-        pnode = unode;
     }
+
+    // tables are sized for their leaves and (at most) one marker per longer leaf going through them, at half load or less
+    for (target = 0; target < hash->count; target ++)
+    {
+        for (low = 0, high = hash->count - 1; low <= high && (middle = (low + high) / 2) != target; )
+        {
+            if (middle < target)
+            {
+                entries[middle] += hash->counts[hash->lengths[target]];
+                low              = middle + 1;
+            }
+            else
+            {
+                high = middle - 1;
+            }
+        }
+    }
+    for (target = 0; target < hash->count; target ++)
+    {
+        for (hash->bits[target] = 2; ((uint32_t)1 << hash->bits[target]) < entries[target] * 2; hash->bits[target] ++);
+        hash->offsets[target] = size;
+        size                 += (uint32_t)1 << hash->bits[target];
+    }
+    if (!(hash->slots = (_PREFIXDB_SLOT *)calloc(size + 1, sizeof(_PREFIXDB_SLOT))))
+    {
+        free(hash);
+        return PREFIXDB_ERROR_MEMORY;
+    }
+    hash->size = size;
+    if (db->nodes_count)
+    {
+        prefixdb_walk(db, 0, 0, 0, 0, prefixdb_hash_fill, hash);
+    }
+    for (size = 0; size < hash->size; size ++)
+    {
+        hash->slots[size].key   = htonl(hash->slots[size].key);
+        hash->slots[size].value = htonl(hash->slots[size].value);
+    }
+    db->hash = hash;
     return PREFIXDB_ERROR_OK;
 }
 
-int prefixdb_free(PREFIXDB **_db)
+// hash section: tables count and slots count, then the length, bits and first slot of each table, then the slots (from the
+// next cache line)
+static inline uint32_t prefixdb_hash_header(uint8_t count)
+{
+    return (8 + (count * 8) + PREFIXDB_CACHELINE - 1) & ~(PREFIXDB_CACHELINE - 1);
+}
+
+static void prefixdb_hash_write(_PREFIXDB_HASH *hash, uint8_t *section)
+{
+    uint8_t table;
+
+    memset(section, 0, prefixdb_hash_header(hash->count));
+    *((uint32_t *)(section))     = htonl(hash->count);
+    *((uint32_t *)(section + 4)) = htonl(hash->size);
+    for (table = 0; table < hash->count; table ++)
+    {
+        *(section + 8 + (table * 8))                    = hash->lengths[table];
+        *(section + 8 + (table * 8) + 1)                = hash->bits[table];
+        *((uint32_t *)(section + 8 + (table * 8) + 4)) = htonl(hash->offsets[table]);
+    }
+    memcpy(section + prefixdb_hash_header(hash->count), hash->slots, hash->size * sizeof(_PREFIXDB_SLOT));
+}
+
+static int prefixdb_hash_attach(_PREFIXDB *db)
+{
+    _PREFIXDB_HASH *hash;
+    uint32_t       count, size;
+    uint8_t        table, length, bits;
+
+    if (db->lookup_size < 8 || (count = ntohl(*(uint32_t *)(db->lookup))) > 32 ||
+        db->lookup_size != prefixdb_hash_header(count) + ((uint64_t)(size = ntohl(*(uint32_t *)(db->lookup + 4))) * sizeof(_PREFIXDB_SLOT)))
+    {
+        return PREFIXDB_ERROR_PARAM;
+    }
+    if (!(hash = (_PREFIXDB_HASH *)calloc(1, sizeof(_PREFIXDB_HASH))))
+    {
+        return PREFIXDB_ERROR_MEMORY;
+    }
+    for (table = 0; table < count; table ++)
+    {
+        length                = *(db->lookup + 8 + (table * 8));
+        bits                  = *(db->lookup + 8 + (table * 8) + 1);
+        hash->offsets[table]  = ntohl(*(uint32_t *)(db->lookup + 8 + (table * 8) + 4));
+        if (length <= (table ? hash->lengths[table - 1] : 0) || length > 32 || bits < 2 || bits > 31 ||
+            (uint64_t)hash->offsets[table] + ((uint32_t)1 << bits) > size)
+        {
+            free(hash);
+            return PREFIXDB_ERROR_PARAM;
+        }
+        hash->lengths[table]  = length;
+        hash->bits[table]     = bits;
+        hash->tables[length]  = table;
+    }
+    hash->count  = count;
+    hash->size   = size;
+    hash->slots  = (_PREFIXDB_SLOT *)(db->lookup + prefixdb_hash_header(count));
+    hash->stored = 1;
+    db->hash     = hash;
+    return PREFIXDB_ERROR_OK;
+}
+
+static inline int prefixdb_hash_lookup(_PREFIXDB *db, uint32_t address, uint8_t *depth, uint32_t *value)
+{
+    _PREFIXDB_HASH *hash = db->hash;
+    _PREFIXDB_SLOT *slots;
+    uint32_t       key, slot, mask;
+    int8_t         low = 0, high = hash->count - 1, middle;
+
+    while (low <= high)
+    {
+        middle = (low + high) / 2;
+        key    = address & PREFIXDB_PREFIX_MASK(hash->lengths[middle]);
+        slots  = hash->slots + hash->offsets[middle];
+        mask   = (1 << hash->bits[middle]) - 1;
+        for (slot = prefixdb_hash_slot(key, hash->bits[middle]); slots[slot].value && slots[slot].key != htonl(key); slot = (slot + 1) & mask);
+        (*depth) ++;
+        if (!slots[slot].value)
+        {
+            high = middle - 1;
+        }
+        else if (slots[slot].value == PREFIXDB_HASH_MARKER)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            *value = ntohl(slots[slot].value);
+            return PREFIXDB_ERROR_OK;
+        }
+    }
+    return PREFIXDB_ERROR_NOTFOUND;
+}
+
+// intervals engine: the leaves are disjoint, so the address space is a sorted sequence of intervals, each either matching a
+// leaf value or none (0); only the last address and value of each interval are kept (adjacent intervals with the same value
+// merged), the last addresses in Eytzinger (breadth-first) order so that a branch-free lower bound search touches ~log2(n)
+// cache lines, prefetching the ones 4 levels below; both arrays are big-endian once built, so that they are used in place
+// from the image intervals section (a mapped image then never faults the nodes section in for lookups)
+static int prefixdb_intervals_count(_PREFIXDB *db, uint32_t address, uint8_t length, uint8_t depth, uint32_t value, void *context)
+{
+    if (value < db->nodes_count || prefixdb_is_skip(db, value))
+    {
+        return 1;
+    }
+    if (value > db->nodes_count)
+    {
+        ((_PREFIXDB_INTERVALS *)context)->size ++;
+    }
+    return 0;
+}
+
+static void prefixdb_intervals_append(_PREFIXDB_INTERVALS *intervals, uint32_t last, uint32_t value)
+{
+    if (intervals->count && intervals->values[intervals->count - 1] == value)
+    {
+        intervals->bounds[intervals->count - 1] = last;
+    }
+    else
+    {
+        intervals->bounds[intervals->count]   = last;
+        intervals->values[intervals->count ++] = value;
+    }
+}
+
+static int prefixdb_intervals_fill(_PREFIXDB *db, uint32_t address, uint8_t length, uint8_t depth, uint32_t value, void *context)
+{
+    _PREFIXDB_INTERVALS *intervals = (_PREFIXDB_INTERVALS *)context;
+    uint32_t            last       = address | ~PREFIXDB_PREFIX_MASK(length);
+
+    if (value < db->nodes_count || prefixdb_is_skip(db, value))
+    {
+        return 1;
+    }
+    if (value > db->nodes_count)
+    {
+        if (address && (!intervals->count || intervals->bounds[intervals->count - 1] < address - 1))
+        {
+            prefixdb_intervals_append(intervals, address - 1, 0);
+        }
+        prefixdb_intervals_append(intervals, last, value);
+    }
+    return 0;
+}
+
+static uint32_t prefixdb_intervals_layout(_PREFIXDB_INTERVALS *intervals, uint32_t *bounds, uint32_t *values, uint32_t index, uint32_t node)
+{
+    if (node <= intervals->count)
+    {
+        index                   = prefixdb_intervals_layout(intervals, bounds, values, index, node * 2);
+        intervals->bounds[node] = htonl(bounds[index]);
+        intervals->values[node] = htonl(values[index ++]);
+        index                   = prefixdb_intervals_layout(intervals, bounds, values, index, (node * 2) + 1);
+    }
+    return index;
+}
+
+static int prefixdb_intervals_build(_PREFIXDB *db)
+{
+    _PREFIXDB_INTERVALS *intervals;
+    uint32_t            *bounds, *values;
+
+    if (!(intervals = (_PREFIXDB_INTERVALS *)calloc(1, sizeof(_PREFIXDB_INTERVALS))))
+    {
+        return PREFIXDB_ERROR_MEMORY;
+    }
+    if (db->nodes_count)
+    {
+        prefixdb_walk(db, 0, 0, 0, 0, prefixdb_intervals_count, intervals);
+    }
+
+    // at most one interval per leaf and one before each leaf and after the last one (the sorted arrays are then laid out again
+    // from index 1, the root of the implicit tree)
+    intervals->size = (intervals->size * 2) + 1;
+    if (!(intervals->bounds = (uint32_t *)malloc(intervals->size * sizeof(uint32_t))) ||
+        !(intervals->values = (uint32_t *)malloc(intervals->size * sizeof(uint32_t))))
+    {
+        free(intervals->bounds);
+        free(intervals);
+        return PREFIXDB_ERROR_MEMORY;
+    }
+    if (db->nodes_count)
+    {
+        prefixdb_walk(db, 0, 0, 0, 0, prefixdb_intervals_fill, intervals);
+    }
+    if (!intervals->count || intervals->bounds[intervals->count - 1] != 0xffffffff)
+    {
+        prefixdb_intervals_append(intervals, 0xffffffff, 0);
+    }
+    bounds = intervals->bounds;
+    values = intervals->values;
+    if (posix_memalign((void **)&(intervals->bounds), PREFIXDB_CACHELINE, (intervals->count + 1) * sizeof(uint32_t)) ||
+        !(intervals->values = (uint32_t *)malloc((intervals->count + 1) * sizeof(uint32_t))))
+    {
+        if (intervals->bounds != bounds)
+        {
+            free(intervals->bounds);
+        }
+        free(bounds);
+        free(values);
+        free(intervals);
+        return PREFIXDB_ERROR_MEMORY;
+    }
+    intervals->bounds[0] = intervals->values[0] = 0;
+    prefixdb_intervals_layout(intervals, bounds, values, 0, 1);
+    intervals->size = intervals->count + 1;
+    free(bounds);
+    free(values);
+    db->intervals = intervals;
+    return PREFIXDB_ERROR_OK;
+}
+
+// intervals section: the last addresses then the values arrays, both starting with the unused slot 0
+static void prefixdb_intervals_write(_PREFIXDB_INTERVALS *intervals, uint8_t *section)
+{
+    memcpy(section, intervals->bounds, intervals->size * sizeof(uint32_t));
+    memcpy(section + (intervals->size * sizeof(uint32_t)), intervals->values, intervals->size * sizeof(uint32_t));
+}
+
+static int prefixdb_intervals_attach(_PREFIXDB *db)
+{
+    _PREFIXDB_INTERVALS *intervals;
+
+    if (db->lookup_size < 16 || db->lookup_size % 8)
+    {
+        return PREFIXDB_ERROR_PARAM;
+    }
+    if (!(intervals = (_PREFIXDB_INTERVALS *)calloc(1, sizeof(_PREFIXDB_INTERVALS))))
+    {
+        return PREFIXDB_ERROR_MEMORY;
+    }
+    intervals->size   = db->lookup_size / 8;
+    intervals->count  = intervals->size - 1;
+    intervals->bounds = (uint32_t *)(db->lookup);
+    intervals->values = (uint32_t *)(db->lookup + (intervals->size * sizeof(uint32_t)));
+    intervals->stored = 1;
+    db->intervals     = intervals;
+    return PREFIXDB_ERROR_OK;
+}
+
+// the last interval ending at 0xffffffff, the lower bound always exists: once past the leaves of the implicit tree, the path
+// goes back up to it by dropping the trailing 1 bits (right turns) and the last left turn
+static inline int prefixdb_intervals_lookup(_PREFIXDB *db, uint32_t address, uint8_t *depth, uint32_t *value)
+{
+    _PREFIXDB_INTERVALS *intervals = db->intervals;
+    uint32_t            *bounds    = intervals->bounds, node = 1;
+
+    while (node <= intervals->count)
+    {
+        __builtin_prefetch(bounds + (node * 16));
+        node = (node * 2) + (ntohl(bounds[node]) < address);
+        (*depth) ++;
+    }
+    node >>= __builtin_ffs(~node);
+    if (!(*value = ntohl(intervals->values[node])))
+    {
+        return PREFIXDB_ERROR_NOTFOUND;
+    }
+    return PREFIXDB_ERROR_OK;
+}
+
+static void prefixdb_engine_release(_PREFIXDB *db)
+{
+    if (db->hash)
+    {
+        if (!db->hash->stored)
+        {
+            free(db->hash->slots);
+        }
+        free(db->hash);
+        db->hash = NULL;
+    }
+    if (db->intervals)
+    {
+        if (!db->intervals->stored)
+        {
+            free(db->intervals->bounds);
+            free(db->intervals->values);
+        }
+        free(db->intervals);
+        db->intervals = NULL;
+    }
+}
+
+// the selected engine structures are used in place from the image section storing them, or built from the image leaves
+// for images saved without it (and released whenever the image changes)
+static int prefixdb_engine_build(_PREFIXDB *db)
+{
+    if (db->engine == PREFIXDB_ENGINE_HASH && !db->hash)
+    {
+        return db->lookup ? prefixdb_hash_attach(db) : prefixdb_hash_build(db);
+    }
+    if (db->engine == PREFIXDB_ENGINE_INTERVALS && !db->intervals)
+    {
+        return db->lookup ? prefixdb_intervals_attach(db) : prefixdb_intervals_build(db);
+    }
+    return PREFIXDB_ERROR_OK;
+}
+
+// (re)build the optional lookup structures derived from the serialized database
+static int prefixdb_options(_PREFIXDB *db)
+{
+    if (!(db->flags & PREFIXDB_FLAGS_PREFILTER) || !(db->flags & PREFIXDB_FLAGS_SERIALIZED))
+    {
+        free(db->prefilter);
+        db->prefilter = NULL;
+    }
+    if (!(db->flags & PREFIXDB_FLAGS_COUNTERS) || !(db->flags & PREFIXDB_FLAGS_SERIALIZED))
+    {
+        free(db->counters);
+        db->counters = NULL;
+    }
+    if (!(db->flags & PREFIXDB_FLAGS_SERIALIZED))
+    {
+        prefixdb_engine_release(db);
+    }
+    else if (prefixdb_engine_build(db) != PREFIXDB_ERROR_OK)
+    {
+        return PREFIXDB_ERROR_MEMORY;
+    }
+    if ((db->flags & PREFIXDB_FLAGS_OPTIONS) && !db->shards)
+    {
+        if (posix_memalign((void **)&(db->shards), PREFIXDB_CACHELINE, PREFIXDB_SHARDS * sizeof(_PREFIXDB_SHARD)))
+        {
+            db->shards = NULL;
+            db->flags &= ~PREFIXDB_FLAGS_OPTIONS;
+            return PREFIXDB_ERROR_MEMORY;
+        }
+        memset(db->shards, 0, PREFIXDB_SHARDS * sizeof(_PREFIXDB_SHARD));
+    }
+    if ((db->flags & PREFIXDB_FLAGS_METRICS) && !db->metrics)
+    {
+        if (posix_memalign((void **)&(db->metrics), PREFIXDB_CACHELINE, PREFIXDB_SHARDS * sizeof(_PREFIXDB_METRICS)))
+        {
+            db->metrics = NULL;
+            db->flags  &= ~PREFIXDB_FLAGS_METRICS;
+            return PREFIXDB_ERROR_MEMORY;
+        }
+        memset(db->metrics, 0, PREFIXDB_SHARDS * sizeof(_PREFIXDB_METRICS));
+    }
+    if ((db->flags & PREFIXDB_FLAGS_COUNTERS) && (db->flags & PREFIXDB_FLAGS_SERIALIZED) && !db->counters)
+    {
+        if (!(db->counters = (uint64_t *)calloc(prefixdb_counters_count(db) + 1, sizeof(uint64_t))))
+        {
+            return PREFIXDB_ERROR_MEMORY;
+        }
+    }
+    if ((db->flags & PREFIXDB_FLAGS_PREFILTER) && (db->flags & PREFIXDB_FLAGS_SERIALIZED) && !db->prefilter)
+    {
+        if (!(db->prefilter = (uint8_t *)calloc(1, (1 << PREFIXDB_PREFILTER_LENGTH) / 8)))
+        {
+            return PREFIXDB_ERROR_MEMORY;
+        }
+        if (db->nodes_count)
+        {
+            prefixdb_walk(db, 0, 0, 0, 0, prefixdb_prefilter_fill, NULL);
+        }
+    }
+    return PREFIXDB_ERROR_OK;
+}
+
+// v1 images end with a 31-bytes trailer: 12 reserved zero bytes, values count (tagged databases only), records size in bits,
+// nodes count, version, file size and magic marker; tagged databases store their values table right after the nodes
+static int prefixdb_trailer(const uint8_t *trailer, uint64_t size, uint32_t *nodes_count, uint8_t *records_size, uint32_t *values_count)
+{
+    uint16_t version;
+
+    if (size < 31 || memcmp(trailer, "\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00", 12) ||
+        ntohl(*(uint32_t *)(trailer + 27)) != PREFIXDB_MAGIC_MARKER || ntohl(*(uint32_t *)(trailer + 23)) != size ||
+        (version = ntohs(*(uint16_t *)(trailer + 21))) > PREFIXDB_TAGGED_VERSION ||
+        (*nodes_count = ntohl(*(uint32_t *)(trailer + 17))) == 0xffffffff || (*records_size = *(trailer + 16)) % 8)
+    {
+        return PREFIXDB_ERROR_PARAM;
+    }
+    *records_size /= 8;
+    *values_count  = ntohl(*(uint32_t *)(trailer + 12));
+    if ((version <= PREFIXDB_PLAIN_VERSION && *values_count) ||
+        ((uint64_t)*nodes_count * *records_size * 2) + ((uint64_t)*values_count * 8) != size - 31)
+    {
+        return PREFIXDB_ERROR_PARAM;
+    }
+    return PREFIXDB_ERROR_OK;
+}
+
+static int prefixdb_load_values(_PREFIXDB *db, const uint8_t *table)
+{
+    uint32_t index;
+
+    if (!db->values_count)
+    {
+        return PREFIXDB_ERROR_OK;
+    }
+    if (!(db->values = (uint64_t *)malloc(db->values_count * sizeof(uint64_t))))
+    {
+        return PREFIXDB_ERROR_MEMORY;
+    }
+    for (index = 0; index < db->values_count; index ++)
+    {
+        db->values[index] = ((uint64_t)ntohl(*(uint32_t *)(table + (index * 8))) << 32) | ntohl(*(uint32_t *)(table + (index * 8) + 4));
+    }
+    return PREFIXDB_ERROR_OK;
+}
+
+// v2 images start with a 64-bytes header (magic marker, version, records size in bits, sections count, nodes count, values
+// count, file size and skips count) followed by the sections directory (type, offset and length of each section); the nodes
+// section is page-aligned and all others cache-line aligned, and sections unknown to this version of the library are ignored
+// (images using skip entries are versioned 2.1, so that 2.0 readers reject them instead of misreading their records)
+static int prefixdb_parse(_PREFIXDB *db)
+{
+    uint8_t  *data = db->data, *entry, *values = NULL;
+    uint64_t offset, length;
+    uint32_t sections, index;
+    uint8_t  records_size;
+
+    db->records = db->skips = db->index = db->summary = db->checksum = db->lookup = NULL;
+    if (db->data_size >= PREFIXDB_HEADER_SIZE && ntohl(*(uint32_t *)data) == PREFIXDB_MAGIC_MARKER &&
+        ((db->version = ntohs(*(uint16_t *)(data + 4))) >> 8) == (PREFIXDB_LIBRARY_VERSION >> 8))
+    {
+        sections = *(data + 7);
+        if (db->version > PREFIXDB_LIBRARY_VERSION || !(records_size = *(data + 6)) || records_size % 8 || records_size > 32 ||
+            ntohl(*(uint32_t *)(data + 16)) != db->data_size || PREFIXDB_HEADER_SIZE + (sections * 16) > db->data_size)
+        {
+            return PREFIXDB_ERROR_PARAM;
+        }
+        db->records_size = records_size / 8;
+        db->nodes_count  = ntohl(*(uint32_t *)(data + 8));
+        db->values_count = ntohl(*(uint32_t *)(data + 12));
+        db->skips_count  = ntohl(*(uint32_t *)(data + 20));
+        db->engine       = *(data + 24) <= PREFIXDB_ENGINE_INTERVALS ? *(data + 24) : PREFIXDB_ENGINE_TRIE;
+        for (index = 0; index < sections; index ++)
+        {
+            entry  = data + PREFIXDB_HEADER_SIZE + (index * 16);
+            offset = ntohl(*(uint32_t *)(entry + 4));
+            length = ntohl(*(uint32_t *)(entry + 8));
+            if (offset + length > db->data_size)
+            {
+                return PREFIXDB_ERROR_PARAM;
+            }
+            switch (ntohl(*(uint32_t *)entry))
+            {
+                case PREFIXDB_SECTION_NODES:
+                    if (length != (uint64_t)db->nodes_count * db->records_size * 2) return PREFIXDB_ERROR_PARAM;
+                    db->records = data + offset;
+                    break;
+                case PREFIXDB_SECTION_VALUES:
+                    if (length != (uint64_t)db->values_count * 8) return PREFIXDB_ERROR_PARAM;
+                    values = data + offset;
+                    break;
+                case PREFIXDB_SECTION_INDEX:
+                    if (length != (4 << PREFIXDB_INDEX_LENGTH)) return PREFIXDB_ERROR_PARAM;
+                    db->index = data + offset;
+                    break;
+                case PREFIXDB_SECTION_SUMMARY:
+                    if (length != PREFIXDB_SUMMARY_SIZE) return PREFIXDB_ERROR_PARAM;
+                    db->summary = data + offset;
+                    break;
+                case PREFIXDB_SECTION_CHECKSUM:
+                    if (length != 8) return PREFIXDB_ERROR_PARAM;
+                    db->checksum = data + offset;
+                    break;
+                case PREFIXDB_SECTION_SKIPS:
+                    if (length != (uint64_t)db->skips_count * (db->records_size + 5)) return PREFIXDB_ERROR_PARAM;
+                    db->skips = data + offset;
+                    break;
+                case PREFIXDB_SECTION_HASH:
+                case PREFIXDB_SECTION_INTERVALS:
+                    if (db->engine == (ntohl(*(uint32_t *)entry) == PREFIXDB_SECTION_HASH ? PREFIXDB_ENGINE_HASH : PREFIXDB_ENGINE_INTERVALS))
+                    {
+                        db->lookup      = data + offset;
+                        db->lookup_size = length;
+                    }
+                    break;
+            }
+        }
+        if (!db->records || (db->values_count && !values) || (db->skips_count && !db->skips) || (!db->nodes_count && !db->index))
+        {
+            return PREFIXDB_ERROR_PARAM;
+        }
+        return prefixdb_load_values(db, values);
+    }
+    if (db->data_size < 31 ||
+        prefixdb_trailer(data + db->data_size - 31, db->data_size, &(db->nodes_count), &(db->records_size), &(db->values_count)) != PREFIXDB_ERROR_OK)
+    {
+        return PREFIXDB_ERROR_PARAM;
+    }
+    db->version     = ntohs(*(uint16_t *)(data + db->data_size - 10));
+    db->records     = data;
+    db->skips_count = 0;
+    return prefixdb_load_values(db, data + ((uint64_t)db->nodes_count * db->records_size * 2));
+}
+
+// FNV-1a over the big-endian 64-bits words of the image (all sections being 8-bytes aligned)
+static uint64_t prefixdb_checksum(const uint8_t *data, uint32_t size)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    uint32_t offset;
+
+    for (offset = 0; offset + 8 <= size; offset += 8)
+    {
+        hash = (hash ^ (((uint64_t)ntohl(*(uint32_t *)(data + offset)) << 32) | ntohl(*(uint32_t *)(data + offset + 4)))) * 0x100000001b3ULL;
+    }
+    for (; offset < size; offset ++)
+    {
+        hash = (hash ^ *(data + offset)) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+PREFIXDB *prefixdb_allocate()
+{
+    return (PREFIXDB *)calloc(1, sizeof(_PREFIXDB));
+}
+
+PREFIXDB *prefixdb_load_binary(const uint8_t *data, uint32_t size, uint8_t flags)
+{
+    _PREFIXDB *db;
+
+    if (!data || size < 31 || !(db = prefixdb_allocate()))
+    {
+        return NULL;
+    }
+    db->data_size    = size;
+    db->flags       |= PREFIXDB_FLAGS_SERIALIZED | PREFIXDB_FLAGS_FREEZE | (flags & PREFIXDB_FLAGS_OPTIONS);
+    prefixdb_generation(db);
+    if (flags & PREFIXDB_FLAGS_COPY)
+    {
+        db->flags |= PREFIXDB_FLAGS_COPY;
+        if (!(db->data = (uint8_t *)malloc(db->data_size)))
+        {
+            prefixdb_free((PREFIXDB *)&db);
+            return NULL;
+        }
+        memcpy(db->data, data, size);
+    }
+    else
+    {
+        db->data = (uint8_t *)data;
+    }
+    if (prefixdb_parse(db) != PREFIXDB_ERROR_OK || prefixdb_options(db) != PREFIXDB_ERROR_OK)
+    {
+        prefixdb_free((PREFIXDB *)&db);
+        return NULL;
+    }
+    return db;
+}
+
+PREFIXDB *prefixdb_load_file(const char *path, uint8_t flags)
+{
+    _PREFIXDB   *db;
+    struct stat info;
+    uint64_t    begin = (flags & PREFIXDB_FLAGS_METRICS) ? prefixdb_clock() : 0;
+    int         handle;
+
+    if (!path || stat(path, &info) < 0 || info.st_size < 31 || info.st_size > 0xffffffff || (handle = open(path, O_RDONLY)) < 0)
+    {
+        return NULL;
+    }
+    if (!(db = prefixdb_allocate()))
+    {
+        close(handle);
+        return NULL;
+    }
+    db->data_size    = info.st_size;
+    db->flags       |= PREFIXDB_FLAGS_SERIALIZED | PREFIXDB_FLAGS_FREEZE | (flags & PREFIXDB_FLAGS_OPTIONS);
+    prefixdb_generation(db);
+    if (flags & PREFIXDB_FLAGS_MMAP)
+    {
+        db->flags |= PREFIXDB_FLAGS_MMAP;
+        db->handle = handle;
+        if ((db->data = (uint8_t *)mmap(NULL, db->data_size, PROT_READ, MAP_SHARED, db->handle, 0)) == MAP_FAILED)
+        {
+            db->data = NULL;
+            close(handle);
+            prefixdb_free((PREFIXDB *)&db);
+            return NULL;
+        }
+
+        // lookups jump around the nodes, and the sections they do not need (statistics, checksum) are never touched
+        madvise(db->data, db->data_size, MADV_RANDOM);
+    }
+    else
+    {
+        db->flags |= PREFIXDB_FLAGS_COPY;
+        if (!(db->data = (uint8_t *)malloc(db->data_size)) || (read(handle, db->data, db->data_size) != db->data_size))
+        {
+            close(handle);
+            prefixdb_free((PREFIXDB *)&db);
+            return NULL;
+        }
+        close(handle);
+    }
+    if (prefixdb_parse(db) != PREFIXDB_ERROR_OK || prefixdb_options(db) != PREFIXDB_ERROR_OK)
+    {
+        prefixdb_free((PREFIXDB *)&db);
+        return NULL;
+    }
+    if (db->flags & PREFIXDB_FLAGS_METRICS)
+    {
+        prefixdb_histogram_add(&(prefixdb_metrics_shard(db)->loads), prefixdb_clock() - begin);
+    }
+    return db;
+}
+
+// build nodes are carved out of large chunks (far fewer allocations, and nodes inserted together end up close in memory),
+// released nodes being kept on a spare list (chained through their up pointer) until the whole build trie is dropped
+static _PREFIXDB_NODE *prefixdb_node_allocate(_PREFIXDB *db, _PREFIXDB_NODE *up)
+{
+    _PREFIXDB_CHUNK *chunk;
+    _PREFIXDB_NODE  *node;
+
+    if ((node = db->spare))
+    {
+        db->spare = node->up;
+    }
+    else
+    {
+        if (!db->chunks || db->chunk_used >= PREFIXDB_CHUNK_NODES)
+        {
+            if (!(chunk = (_PREFIXDB_CHUNK *)malloc(sizeof(_PREFIXDB_CHUNK))))
+            {
+                return NULL;
+            }
+            chunk->next    = db->chunks;
+            db->chunks     = chunk;
+            db->chunk_used = 0;
+            db->chunks_count ++;
+        }
+        node = db->chunks->nodes + db->chunk_used ++;
+    }
+    memset(node, 0, sizeof(_PREFIXDB_NODE));
+    node->up = up;
+    return node;
+}
+
+static void prefixdb_node_release(_PREFIXDB *db, _PREFIXDB_NODE *node)
+{
+    node->up  = db->spare;
+    db->spare = node;
+}
+
+// drop the whole build trie at once
+static void prefixdb_chunks_release(_PREFIXDB *db)
+{
+    _PREFIXDB_CHUNK *chunk;
+
+    while ((chunk = db->chunks))
+    {
+        db->chunks = chunk->next;
+        free(chunk);
+    }
+    db->spare        = NULL;
+    db->chunk_used   = db->chunks_count = 0;
+    db->nodes.down[0] = db->nodes.down[1] = NULL;
+    db->nodes.tags    = 0;
+}
+
+static int prefixdb_free_down(_PREFIXDB *db, _PREFIXDB_NODE *node)
+{
+    _PREFIXDB_NODE *pnode, *unode;
+
+    pnode = node;
+    while (1)
+    {
+        while (pnode->down[0])
+        {
+            pnode = pnode->down[0];
+        }
+        if (pnode->down[1])
+        {
+            pnode = pnode->down[1];
+            continue;
+        }
+        if (pnode == node)
+        {
+            break;
+        }
+        unode = pnode->up;
+        unode->down[unode->down[0] == pnode ? 0 : 1] = NULL;
+        prefixdb_node_release(db, pnode);
+        pnode = unode;
+    }
+    return PREFIXDB_ERROR_OK;
+}
+
+int prefixdb_free(PREFIXDB **_db)
+{
+    _PREFIXDB *db;
+
+    if (!_db || !(db = (_PREFIXDB *)*_db))
+    {
+        return PREFIXDB_ERROR_PARAM;
+    }
+    prefixdb_chunks_release(db);
+    if (db->data)
+    {
+        if (db->flags & PREFIXDB_FLAGS_COPY)
+        {
+            free(db->data);
+        }
+        else if (db->flags & PREFIXDB_FLAGS_MMAP)
+        {
+            munmap(db->data, db->data_size);
+            close(db->handle);
+        }
+    }
+    prefixdb_engine_release(db);
+    free(db->prefilter);
+    free(db->counters);
+    free(db->shards);
+    free(db->metrics);
+    free(db->values);
+    free(*_db);
+    return PREFIXDB_ERROR_OK;
+}
+
+int prefixdb_set_flags(PREFIXDB *_db, uint8_t flags, uint8_t enable)
+{
+    _PREFIXDB *db = (_PREFIXDB *)_db;
+
+    if (!db || (flags & ~PREFIXDB_FLAGS_OPTIONS))
+    {
+        return PREFIXDB_ERROR_PARAM;
+    }
+    if (enable)
+    {
+        db->flags |= flags;
+    }
+    else
+    {
+        db->flags &= ~flags;
+    }
+    return prefixdb_options(db);
+}
+
+// the structures of the selected engine are stored as the image section preceding the checksum one (replacing the one
+// of the previously selected engine, the image being resized accordingly), so that loading the image uses them in place
+// instead of building them again in every process; the engine is recorded in the header and the checksum is computed again
+static int prefixdb_engine_store(_PREFIXDB *db)
+{
+    uint64_t checksum;
+    uint32_t position, length = 0, size, type, index, count;
+    uint8_t  *data, *entry;
+    int      status;
+
+    *(db->data + 24) = db->engine;
+    if (!db->checksum)
+    {
+        return PREFIXDB_ERROR_OK;
+    }
+    prefixdb_engine_release(db);
+    position        = (db->lookup ? db->lookup : db->checksum) - db->data;
+    db->lookup      = NULL;
+    db->lookup_size = 0;
+    if (db->engine == PREFIXDB_ENGINE_HASH)
+    {
+        if ((status = prefixdb_hash_build(db)) != PREFIXDB_ERROR_OK)
+        {
+            return status;
+        }
+        length = prefixdb_hash_header(db->hash->count) + (db->hash->size * sizeof(_PREFIXDB_SLOT));
+    }
+    else if (db->engine == PREFIXDB_ENGINE_INTERVALS)
+    {
+        if ((status = prefixdb_intervals_build(db)) != PREFIXDB_ERROR_OK)
+        {
+            return status;
+        }
+        length = db->intervals->size * 2 * sizeof(uint32_t);
+    }
+    size = ((position + length + PREFIXDB_CACHELINE - 1) & ~(PREFIXDB_CACHELINE - 1)) + 8;
+    if (size != db->data_size)
+    {
+        if (db->flags & PREFIXDB_FLAGS_MMAP)
+        {
+            munmap(db->data, db->data_size);
+            if (ftruncate(db->handle, size) < 0 || posix_fallocate(db->handle, 0, size) ||
+                (data = (uint8_t *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, db->handle, 0)) == MAP_FAILED)
+            {
+                db->data = NULL;
+                return PREFIXDB_ERROR_ACCESS;
+            }
+        }
+        else if (!(data = (uint8_t *)realloc(db->data, size)))
+        {
+            return PREFIXDB_ERROR_MEMORY;
+        }
+        db->records   = data + (db->records - db->data);
+        db->skips     = db->skips ? data + (db->skips - db->data) : NULL;
+        db->index     = db->index ? data + (db->index - db->data) : NULL;
+        db->summary   = db->summary ? data + (db->summary - db->data) : NULL;
+        db->data      = data;
+        db->data_size = size;
+    }
+    db->checksum = db->data + size - 8;
+    memset(db->data + position, 0, size - position);
+
+    // the directory keeps the sections found before the engine one, then gets the engine and checksum sections again
+    for (index = 0, count = 0; index < *(db->data + 7); index ++)
+    {
+        entry = db->data + PREFIXDB_HEADER_SIZE + (index * 16);
+        type  = ntohl(*(uint32_t *)entry);
+        if (type != PREFIXDB_SECTION_HASH && type != PREFIXDB_SECTION_INTERVALS && type != PREFIXDB_SECTION_CHECKSUM &&
+            ntohl(*(uint32_t *)(entry + 4)) < position)
+        {
+            memmove(db->data + PREFIXDB_HEADER_SIZE + (count ++ * 16), entry, 16);
+        }
+    }
+    if (length)
+    {
+        type = (db->engine == PREFIXDB_ENGINE_HASH) ? PREFIXDB_SECTION_HASH : PREFIXDB_SECTION_INTERVALS;
+        *((uint32_t *)(db->data + PREFIXDB_HEADER_SIZE + (count * 16)))     = htonl(type);
+        *((uint32_t *)(db->data + PREFIXDB_HEADER_SIZE + (count * 16) + 4)) = htonl(position);
+        *((uint32_t *)(db->data + PREFIXDB_HEADER_SIZE + (count * 16) + 8)) = htonl(length);
+        count ++;
+        db->lookup      = db->data + position;
+        db->lookup_size = length;
+        if (type == PREFIXDB_SECTION_HASH)
+        {
+            prefixdb_hash_write(db->hash, db->lookup);
+        }
+        else
+        {
+            prefixdb_intervals_write(db->intervals, db->lookup);
+        }
+        prefixdb_engine_release(db);
+        if ((status = prefixdb_engine_build(db)) != PREFIXDB_ERROR_OK)
+        {
+            return status;
+        }
+    }
+    *((uint32_t *)(db->data + PREFIXDB_HEADER_SIZE + (count * 16)))     = htonl(PREFIXDB_SECTION_CHECKSUM);
+    *((uint32_t *)(db->data + PREFIXDB_HEADER_SIZE + (count * 16) + 4)) = htonl(size - 8);
+    *((uint32_t *)(db->data + PREFIXDB_HEADER_SIZE + (count * 16) + 8)) = htonl(8);
+    *(db->data + 7)                 = count + 1;
+    *((uint32_t *)(db->data + 16)) = htonl(size);
+    checksum = prefixdb_checksum(db->data, size - 8);
+    *((uint32_t *)(db->checksum))     = htonl(checksum >> 32);
+    *((uint32_t *)(db->checksum + 4)) = htonl(checksum & 0xffffffff);
+    return PREFIXDB_ERROR_OK;
+}
+
+// select the lookup engine, recorded in the image (with its structures) so that it is used again when the saved image is
+// loaded (images not owned in memory are copied first, so that neither mapped files nor caller buffers are modified)
+int prefixdb_set_engine(PREFIXDB *_db, uint8_t engine)
+{
+    _PREFIXDB *db = (_PREFIXDB *)_db;
+    uint8_t   *data;
+    int       status;
+
+    if (!db || engine > PREFIXDB_ENGINE_INTERVALS)
+    {
+        return PREFIXDB_ERROR_PARAM;
+    }
+    if (engine == db->engine)
+    {
+        return PREFIXDB_ERROR_OK;
+    }
+    prefixdb_engine_release(db);
+    db->engine = engine;
+    if ((db->flags & PREFIXDB_FLAGS_SERIALIZED) && db->data && (db->version >> 8) == (PREFIXDB_LIBRARY_VERSION >> 8))
+    {
+        if (!(db->flags & PREFIXDB_FLAGS_COPY))
+        {
+            if (!(data = (uint8_t *)malloc(db->data_size)))
+            {
+                return PREFIXDB_ERROR_MEMORY;
+            }
+            memcpy(data, db->data, db->data_size);
+            if (db->flags & PREFIXDB_FLAGS_MMAP)
+            {
+                munmap(db->data, db->data_size);
+                close(db->handle);
+                db->handle = -1;
+            }
+            db->records  = data + (db->records - db->data);
+            db->skips    = db->skips ? data + (db->skips - db->data) : NULL;
+            db->index    = db->index ? data + (db->index - db->data) : NULL;
+            db->summary  = db->summary ? data + (db->summary - db->data) : NULL;
+            db->checksum = db->checksum ? data + (db->checksum - db->data) : NULL;
+            db->lookup   = db->lookup ? data + (db->lookup - db->data) : NULL;
+            db->data     = data;
+            db->flags    = (db->flags & ~PREFIXDB_FLAGS_MMAP) | PREFIXDB_FLAGS_COPY;
+        }
+        if ((status = prefixdb_engine_store(db)) != PREFIXDB_ERROR_OK)
+        {
+            return status;
+        }
+    }
+    return prefixdb_options(db);
+}
+
+// only leaves carry tags (the lists masks of the prefixes they stand for), internal nodes always have none
+static uint64_t prefixdb_tags_down(_PREFIXDB_NODE *node)
+{
+    if (!node->down[0] && !node->down[1])
+    {
+        return node->tags;
+    }
+    return (node->down[0] ? prefixdb_tags_down(node->down[0]) : 0) | (node->down[1] ? prefixdb_tags_down(node->down[1]) : 0);
+}
+
+// OR tags into all the leaves below node, turning its empty branches into leaves carrying only these tags
+static int prefixdb_push_down(_PREFIXDB *db, _PREFIXDB_NODE *node, uint64_t tags)
+{
+    uint8_t type;
+
+    for (type = 0; type <= 1; type ++)
+    {
+        if (!node->down[type])
+        {
+            if (!(node->down[type] = prefixdb_node_allocate(db, node)))
+            {
+                return PREFIXDB_ERROR_MEMORY;
+            }
+            node->down[type]->tags = tags;
+        }
+        else if (!node->down[type]->down[0] && !node->down[type]->down[1])
+        {
+            node->down[type]->tags |= tags;
+        }
+        else if (prefixdb_push_down(db, node->down[type], tags) != PREFIXDB_ERROR_OK)
+        {
+            return PREFIXDB_ERROR_MEMORY;
+        }
+    }
+    return PREFIXDB_ERROR_OK;
+}
+
+// insert a prefix from path[depth] (the node standing for its first depth bits), recording the nodes visited in path and the
+// depth of the last one in reached
+static int prefixdb_insert_from(_PREFIXDB *db, _PREFIXDB_NODE **path, uint8_t depth, uint32_t address, uint8_t length, uint64_t tags, uint8_t *reached)
+{
+    _PREFIXDB_NODE *pnode, *anode;
+    int8_t         bit, type = 0;
+
+    pnode    = path[depth];
+    *reached = depth;
+    for (bit = 31 - depth; bit > 31 - length; bit --)
+    {
+        if (pnode->tags)
+        {
+            if ((pnode->tags | tags) == pnode->tags) // longer prefix redux
+            {
+                return PREFIXDB_ERROR_OK;
+            }
+            for (type = 0; type <= 1; type ++) // split a shorter prefix from other lists
+            {
+                if (!(pnode->down[type] = anode = prefixdb_node_allocate(db, pnode)))
+                {
+                    return PREFIXDB_ERROR_MEMORY;
+                }
+                anode->tags = pnode->tags;
+            }
+            pnode->tags = 0;
+        }
+        type = (address & ((uint32_t)1 << bit)) ? 1 : 0;
+        if (!(pnode->down[type]))
+        {
+            if (!(pnode->down[type] = prefixdb_node_allocate(db, pnode)))
+            {
+                return PREFIXDB_ERROR_MEMORY;
+            }
+        }
+        pnode = path[++ (*reached)] = pnode->down[type];
+    }
+    if (!pnode->down[0] && !pnode->down[1])
+    {
+        pnode->tags |= tags;
+        return PREFIXDB_ERROR_OK;
+    }
+    if ((prefixdb_tags_down(pnode) | tags) == tags) // shorter prefix redux
+    {
+        prefixdb_free_down(db, pnode);
+        pnode->tags = tags;
+        return PREFIXDB_ERROR_OK;
+    }
+    return prefixdb_push_down(db, pnode, tags);
+}
+
+static int prefixdb_insert(_PREFIXDB *db, uint32_t address, uint8_t length, uint64_t tags)
+{
+    _PREFIXDB_NODE *path[33];
+    uint8_t        reached;
+
+    path[0] = &(db->nodes);
+    return prefixdb_insert_from(db, path, 0, address, length, tags, &reached);
+}
+
+static int prefixdb_thaw_walk(_PREFIXDB *db, uint32_t address, uint8_t length, uint8_t depth, uint32_t value, void *context)
+{
+    if (value < db->nodes_count || prefixdb_is_skip(db, value))
+    {
+        return 1;
+    }
+    if (value > db->nodes_count && (*(int *)context = prefixdb_insert(db, address, length, prefixdb_value_tags(db, value))) != PREFIXDB_ERROR_OK)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+// a frozen database (released by prefixdb_freeze() or loaded from an image) has no build trie: it is rebuilt from the image
+// leaves, which serializes back to the very same image
+int prefixdb_thaw(PREFIXDB *_db)
+{
+    _PREFIXDB *db = (_PREFIXDB *)_db;
+    int       status = PREFIXDB_ERROR_OK;
+
+    if (!db)
+    {
+        return PREFIXDB_ERROR_PARAM;
+    }
+    if (!(db->flags & PREFIXDB_FLAGS_FREEZE))
+    {
+        return PREFIXDB_ERROR_OK;
+    }
+    if (db->nodes_count && prefixdb_walk(db, 0, 0, 0, 0, prefixdb_thaw_walk, &status) < 0)
+    {
+        prefixdb_chunks_release(db);
+        return status != PREFIXDB_ERROR_OK ? status : PREFIXDB_ERROR_PARAM;
+    }
+    db->flags &= ~PREFIXDB_FLAGS_FREEZE;
+    return PREFIXDB_ERROR_OK;
+}
+
+int prefixdb_add_binary_tagged(PREFIXDB *_db, uint32_t address, uint8_t length, uint64_t tags)
+{
+    _PREFIXDB *db = (_PREFIXDB *)_db;
+    int       status;
+
+    if (!db || length <= 0 || length > 32 || !tags)
+    {
+        return PREFIXDB_ERROR_PARAM;
+    }
+    if ((status = prefixdb_thaw(db)) != PREFIXDB_ERROR_OK)
+    {
+        return status;
+    }
+    db->flags &= ~PREFIXDB_FLAGS_SERIALIZED;
+    return prefixdb_insert(db, address, length, tags);
+}
+
+int prefixdb_add_binary(PREFIXDB *_db, uint32_t address, uint8_t length, const PREFIXDBINFO *__info)
+{
+    return prefixdb_add_binary_tagged(_db, address, length, 1);
+}
+
+// LSD radix sort of 40-bits keys (bytes shared by all the keys are skipped), returning the buffer holding the sorted keys
+static uint64_t *prefixdb_radix_sort(uint64_t *keys, uint64_t *scratch, uint32_t count)
+{
+    uint64_t *swap;
+    uint32_t counts[256], index, total, current;
+    uint8_t  shift;
+
+    for (shift = 0; shift < 40; shift += 8)
+    {
+        memset(counts, 0, sizeof(counts));
+        for (index = 0; index < count; index ++)
+        {
+            counts[(keys[index] >> shift) & 0xff] ++;
+        }
+        if (counts[(keys[0] >> shift) & 0xff] == count)
+        {
+            continue;
+        }
+        for (index = 0, total = 0; index < 256; index ++)
+        {
+            current       = counts[index];
+            counts[index] = total;
+            total        += current;
+        }
+        for (index = 0; index < count; index ++)
+        {
+            scratch[counts[(keys[index] >> shift) & 0xff] ++] = keys[index];
+        }
+        swap    = keys;
+        keys    = scratch;
+        scratch = swap;
+    }
+    return keys;
+}
+
+// batched inserts: prefixes are sorted by address then length, those covered by a shorter (or identical) prefix of the same
+// batch are dropped, and each one is inserted from the deepest node its path shares with the previous one, so that common
+// ancestors are only walked once and new nodes are allocated in address order
+int prefixdb_add_binary_batch_tagged(PREFIXDB *_db, const uint32_t *addresses, const uint8_t *lengths, uint32_t count, uint64_t tags)
+{
+    _PREFIXDB      *db = (_PREFIXDB *)_db;
+    _PREFIXDB_NODE *path[33];
+    uint64_t       *keys, *sorted;
+    uint32_t       index, address, previous = 0, cover = 0;
+    uint8_t        length, covering = 0, reached = 0, start;
+    int            status = PREFIXDB_ERROR_OK;
+
+    if (!db || (count && (!addresses || !lengths)) || !tags)
+    {
+        return PREFIXDB_ERROR_PARAM;
+    }
+    for (index = 0; index < count; index ++)
+    {
+        if (!lengths[index] || lengths[index] > 32)
+        {
+            return PREFIXDB_ERROR_PARAM;
+        }
+    }
+    if (!count)
+    {
+        return PREFIXDB_ERROR_OK;
+    }
+    if ((status = prefixdb_thaw(db)) != PREFIXDB_ERROR_OK)
+    {
+        return status;
+    }
+    if (!(keys = (uint64_t *)malloc(count * 2 * sizeof(uint64_t))))
+    {
+        return PREFIXDB_ERROR_MEMORY;
+    }
+    for (index = 0; index < count; index ++)
+    {
+        keys[index] = ((uint64_t)(addresses[index] & PREFIXDB_PREFIX_MASK(lengths[index])) << 8) | lengths[index];
+    }
+    sorted     = prefixdb_radix_sort(keys, keys + count, count);
+    db->flags &= ~PREFIXDB_FLAGS_SERIALIZED;
+    path[0]    = &(db->nodes);
+    for (index = 0; index < count; index ++)
+    {
+        address = sorted[index] >> 8;
+        length  = sorted[index] & 0xff;
+        if (covering && !((address ^ cover) & PREFIXDB_PREFIX_MASK(covering)))
+        {
+            continue;
+        }
+        cover    = address;
+        covering = length;
+        start    = (address == previous) ? 32 : __builtin_clz(address ^ previous);
+        start    = start < reached ? start : reached;
+        start    = start < length ? start : length;
+        if ((status = prefixdb_insert_from(db, path, start, address, length, tags, &reached)) != PREFIXDB_ERROR_OK)
+        {
+            break;
+        }
+        previous = address;
+    }
+    free(keys);
+    return status;
+}
+
+int prefixdb_add_binary_batch(PREFIXDB *_db, const uint32_t *addresses, const uint8_t *lengths, uint32_t count)
+{
+    return prefixdb_add_binary_batch_tagged(_db, addresses, lengths, count, 1);
+}
+
+int prefixdb_add_string(PREFIXDB *_db, const char *prefix, const void *__info)
+{
+    return prefixdb_add_string_tagged(_db, prefix, 1);
+}
+
+static int prefixdb_string_prefix(const char *prefix, uint32_t *address, uint8_t *length)
+{
+    struct in_addr value;
+    int            bits = 32;
+    char           line[64], *token;
+
+    if (!prefix)
+    {
+        return PREFIXDB_ERROR_PARAM;
+    }
+    memset(line, 0, sizeof(line));
+    snprintf(line, sizeof(line), "%s", prefix);
+    if ((token = strchr(line, '/')))
+    {
+        *token = 0;
+        bits   = atoi(token + 1);
+    }
+    if (!inet_aton(line, &value) || bits <= 0 || bits > 32)
+    {
+        return PREFIXDB_ERROR_PARAM;
+    }
+    *address = htonl(value.s_addr);
+    *length  = bits;
+    return PREFIXDB_ERROR_OK;
+}
+
+int prefixdb_add_string_tagged(PREFIXDB *_db, const char *prefix, uint64_t tags)
+{
+    uint32_t address;
+    uint8_t  length;
+
+    if (prefixdb_string_prefix(prefix, &address, &length) != PREFIXDB_ERROR_OK)
+    {
+        return PREFIXDB_ERROR_PARAM;
+    }
+    return prefixdb_add_binary_tagged(_db, address, length, tags);
+}
+
+int prefixdb_add_file(PREFIXDB *_db, const char *path)
+{
+    return prefixdb_add_file_tagged(_db, path, 1);
+}
+
+// lists files are inserted by batches (all the prefixes preceding an invalid line being added nonetheless)
+int prefixdb_add_file_tagged(PREFIXDB *_db, const char *path, uint64_t tags)
+{
+    FILE     *input;
+    uint32_t *addresses, count = 0;
+    uint8_t  *lengths;
+    int      status = PREFIXDB_ERROR_OK, error = PREFIXDB_ERROR_OK;
+    char     line[64], *token;
+
+    if (!_db || !path || !(input = fopen(path, "r")))
+    {
+        return PREFIXDB_ERROR_PARAM;
+    }
+    addresses = (uint32_t *)malloc(PREFIXDB_FILE_BATCH * sizeof(uint32_t));
+    lengths   = (uint8_t *)malloc(PREFIXDB_FILE_BATCH * sizeof(uint8_t));
+    if (!addresses || !lengths)
+    {
+        free(addresses);
+        free(lengths);
+        fclose(input);
+        return PREFIXDB_ERROR_MEMORY;
+    }
+    while (status == PREFIXDB_ERROR_OK && !error && fgets(line, sizeof(line) - 1, input))
+    {
+        if ((token = strpbrk(line, "#\r\n")))
+        {
+            *token = 0;
+        }
+        if (*line)
+        {
+            if ((error = prefixdb_string_prefix(line, addresses + count, lengths + count)) == PREFIXDB_ERROR_OK && ++ count == PREFIXDB_FILE_BATCH)
+            {
+                status = prefixdb_add_binary_batch_tagged(_db, addresses, lengths, count, tags);
+                count  = 0;
+            }
+        }
+    }
+    if (status == PREFIXDB_ERROR_OK && count)
+    {
+        status = prefixdb_add_binary_batch_tagged(_db, addresses, lengths, count, tags);
+    }
+    free(addresses);
+    free(lengths);
+    fclose(input);
+    return status != PREFIXDB_ERROR_OK ? status : error;
+}
+
+static int prefixdb_write_node(_PREFIXDB *db, uint32_t node, uint32_t value0, uint32_t value1)
+{
+    uint8_t *base = db->records + (node * 2 * db->records_size), count;
+
+    if (!db || !db->data || node >= db->nodes_count || value0 >= db->data_size || value1 >= db->data_size)
+    {
+        return PREFIXDB_ERROR_PARAM;
+    }
+    count = db->records_size;
+    while (count)
+    {
+        *(base + count - 1) = (uint8_t)(value0 & 0xff);
+        value0 >>= 8;
+        count --;
+    }
+    count = db->records_size;
+    while (count)
+    {
+        *(base + db->records_size + count - 1) = (uint8_t)(value1 & 0xff);
+        value1 >>= 8;
+        count --;
+    }
+    return PREFIXDB_ERROR_OK;
+}
+
+static int prefixdb_collect_value(_PREFIXDB *db, uint64_t tags, uint32_t *capacity)
+{
+    uint64_t *values;
+
+    if (db->values_count >= *capacity)
+    {
+        if (!(values = (uint64_t *)realloc(db->values, (*capacity ? *capacity * 2 : 1024) * sizeof(uint64_t))))
+        {
+            return PREFIXDB_ERROR_MEMORY;
+        }
+        db->values = values;
+        *capacity  = *capacity ? *capacity * 2 : 1024;
+    }
+    db->values[db->values_count ++] = tags;
+    return PREFIXDB_ERROR_OK;
+}
+
+static int prefixdb_compare_values(const void *value1, const void *value2)
+{
+    return *(uint64_t *)value1 < *(uint64_t *)value2 ? -1 : (*(uint64_t *)value1 > *(uint64_t *)value2 ? 1 : 0);
+}
+
+// sort and deduplicate the collected leaves tags: databases with a single list keep the plain v1 layout (all leaves pointing
+// to the first value, without a values table)
+static void prefixdb_values_sort(_PREFIXDB *db)
+{
+    uint32_t count, size;
+
+    if (db->values_count)
+    {
+        qsort(db->values, db->values_count, sizeof(uint64_t), prefixdb_compare_values);
+        for (size = 1, count = 1; count < db->values_count; count ++)
+        {
+            if (db->values[count] != db->values[size - 1])
+            {
+                db->values[size ++] = db->values[count];
+            }
+        }
+        db->values_count = size;
+        if (db->values_count == 1 && db->values[0] == 1)
+        {
+            free(db->values);
+            db->values       = NULL;
+            db->values_count = 0;
+        }
+    }
+}
+
+// single-child nodes (other than the root) are path-compressed when they are part of a chain of at least two of them: the
+// chain first node gets a skip entry id, the others no id at all
+static inline int prefixdb_single(_PREFIXDB_NODE *node)
+{
+    return node && node->up && (!node->down[0] != !node->down[1]);
+}
+
+static inline int prefixdb_collapsed(_PREFIXDB_NODE *node)
+{
+    return prefixdb_single(node) && (prefixdb_single(node->up) || prefixdb_single(node->down[0] ? node->down[0] : node->down[1]));
+}
+
+static inline uint32_t prefixdb_number(_PREFIXDB *db, _PREFIXDB_NODE *node)
+{
+    if (prefixdb_collapsed(node))
+    {
+        return prefixdb_single(node->up) ? 0 : db->skips_count ++;
+    }
+    return db->nodes_count ++;
+}
+
+// record value of a leaf: the position of its tags in the (sorted) values table, past the nodes ids
+static uint32_t prefixdb_leaf_value(_PREFIXDB *db, uint64_t tags)
+{
+    uint32_t low = 0, high, middle;
+
+    if (db->values_count)
+    {
+        high = db->values_count - 1;
+        while (low < high)
+        {
+            middle = (low + high) / 2;
+            if (db->values[middle] < tags) low  = middle + 1;
+            else                           high = middle;
+        }
+    }
+    return db->nodes_count + 16 + low;
+}
+
+// record value pointing to node: its id for an internal node (offset past the leaves values for a skip entry), the position of its tags in the values table for a leaf
+static uint32_t prefixdb_node_value(_PREFIXDB *db, _PREFIXDB_NODE *node)
+{
+    if (!node)
+    {
+        return db->nodes_count;
+    }
+    if (node->down[0] || node->down[1])
+    {
+        return prefixdb_collapsed(node) ? prefixdb_skips_base(db) + node->id : node->id;
+    }
+    return prefixdb_leaf_value(db, node->tags);
+}
+
+// write the records of an internal build node, or the skip entry of the chain of single-child nodes it starts
+static int prefixdb_write_trie_node(_PREFIXDB *db, _PREFIXDB_NODE *node)
+{
+    _PREFIXDB_NODE *last, *pnode;
+    uint32_t       prefix = 0, value;
+    uint8_t        *entry, length = 0, count;
+
+    if (!prefixdb_collapsed(node))
+    {
+        return prefixdb_write_node(db, node->id, prefixdb_node_value(db, node->down[0]), prefixdb_node_value(db, node->down[1]));
+    }
+    if (prefixdb_single(node->up))
+    {
+        return PREFIXDB_ERROR_OK;
+    }
+    if (node->id >= db->skips_count)
+    {
+        return PREFIXDB_ERROR_PARAM;
+    }
+    for (last = node; prefixdb_single(last); last = last->down[0] ? last->down[0] : last->down[1]);
+    for (pnode = last; pnode->up; pnode = pnode->up, length ++)
+    {
+        prefix = (prefix >> 1) | (pnode->up->down[1] == pnode ? 0x80000000 : 0);
+    }
+    entry    = db->skips + (node->id * (db->records_size + 5));
+    entry[0] = prefix >> 24;
+    entry[1] = prefix >> 16;
+    entry[2] = prefix >> 8;
+    entry[3] = prefix;
+    entry[4] = length;
+    value    = prefixdb_node_value(db, last);
+    for (count = db->records_size; count; count --)
+    {
+        entry[4 + count] = (uint8_t)(value & 0xff);
+        value          >>= 8;
+    }
+    return PREFIXDB_ERROR_OK;
+}
+
+static int prefixdb_index_fill(_PREFIXDB *db, uint32_t address, uint8_t length, uint8_t depth, uint32_t value, void *context)
+{
+    uint32_t first, count;
+
+    if ((value < db->nodes_count || prefixdb_is_skip(db, value)) && length < PREFIXDB_INDEX_LENGTH)
+    {
+        // skip entries crossing the index length are entered from the single index entry on their path
+        if (prefixdb_is_skip(db, value) && prefixdb_skip_entry(db, value)[4] > PREFIXDB_INDEX_LENGTH)
+        {
+            first = prefixdb_skip_prefix(prefixdb_skip_entry(db, value)) >> (32 - PREFIXDB_INDEX_LENGTH);
+            *((uint32_t *)(db->index + (first * 4))) = htonl(value);
+            return 0;
+        }
+        return 1;
+    }
+    first = address >> (32 - PREFIXDB_INDEX_LENGTH);
+    for (count = 0; count < (1 << (PREFIXDB_INDEX_LENGTH - length)); count ++)
+    {
+        *((uint32_t *)(db->index + ((first + count) * 4))) = htonl(value);
+    }
+    return 0;
+}
+
+static int prefixdb_stats_walk(_PREFIXDB *db, uint32_t address, uint8_t length, uint8_t depth, uint32_t value, void *context)
+{
+    PREFIXDBSTATS *stats = (PREFIXDBSTATS *)context;
+
+    if (value < db->nodes_count || prefixdb_is_skip(db, value))
+    {
+        return 1;
+    }
+    if (value > db->nodes_count)
+    {
+        stats->leaves ++;
+        stats->lengths[length] ++;
+        stats->depths[depth] ++;
+    }
+    if (depth > stats->depth_max)
+    {
+        stats->depth_max = depth;
+    }
+    stats->depth_average += (double)depth / ((uint64_t)1 << length);
+    return 0;
+}
+
+// the summary section keeps the walk-derived statistics (leaves, depths, prefixes lengths) so that they are available without
+// touching all the nodes: leaves count, max depth, leaves per length and per depth, then average depth in millionths
+static void prefixdb_summarize(_PREFIXDB *db)
+{
+    PREFIXDBSTATS stats;
+    uint64_t      average;
+    uint32_t      index;
+
+    memset(&stats, 0, sizeof(stats));
+    if (db->nodes_count)
+    {
+        prefixdb_walk(db, 0, 0, 0, 0, prefixdb_stats_walk, &stats);
+    }
+    average = stats.depth_average * 1000000;
+    *((uint32_t *)(db->summary))     = htonl(stats.leaves);
+    *((uint32_t *)(db->summary + 4)) = htonl(stats.depth_max);
+    for (index = 0; index <= 32; index ++)
+    {
+        *((uint32_t *)(db->summary + 8 + (index * 4)))        = htonl(stats.lengths[index]);
+        *((uint32_t *)(db->summary + 8 + ((33 + index) * 4))) = htonl(stats.depths[index]);
+    }
+    *((uint32_t *)(db->summary + PREFIXDB_SUMMARY_SIZE - 8)) = htonl(average >> 32);
+    *((uint32_t *)(db->summary + PREFIXDB_SUMMARY_SIZE - 4)) = htonl(average & 0xffffffff);
+}
+
+// allocate (or map from handle) the image of db nodes, skips and values counts, writing its header, sections directory and
+// values table: the nodes and skip entries are written next, then prefixdb_seal() fills the remaining sections (and adds
+// the engine one)
+static int prefixdb_layout(_PREFIXDB *db, int handle)
+{
+    uint32_t count, size, offsets[PREFIXDB_SECTIONS], lengths[PREFIXDB_SECTIONS];
+    uint8_t  type, index;
+
+    // sections layout order (the checksum covering all the preceding bytes)
+    static const uint8_t sections[] =
+    {
+        PREFIXDB_SECTION_NODES, PREFIXDB_SECTION_VALUES, PREFIXDB_SECTION_SKIPS, PREFIXDB_SECTION_INDEX, PREFIXDB_SECTION_SUMMARY,
+        PREFIXDB_SECTION_CHECKSUM
+    };
+
+    db->records_size = 0;
+    count            = db->nodes_count + 16 + db->values_count + db->skips_count;
+    do
+    {
+        db->records_size ++;
+    } while (count /= 256);
+    lengths[PREFIXDB_SECTION_NODES]    = 2 * db->records_size * db->nodes_count;
+    lengths[PREFIXDB_SECTION_VALUES]   = db->values_count * 8;
+    lengths[PREFIXDB_SECTION_SKIPS]    = db->skips_count * (db->records_size + 5);
+    lengths[PREFIXDB_SECTION_INDEX]    = 4 << PREFIXDB_INDEX_LENGTH;
+    lengths[PREFIXDB_SECTION_SUMMARY]  = PREFIXDB_SUMMARY_SIZE;
+    lengths[PREFIXDB_SECTION_CHECKSUM] = 8;
+    for (index = 0, size = PREFIXDB_PAGE_SIZE; index < sizeof(sections); index ++)
+    {
+        type           = sections[index];
+        size           = (size + (type == PREFIXDB_SECTION_NODES ? PREFIXDB_PAGE_SIZE : PREFIXDB_CACHELINE) - 1) &
+                         ~((type == PREFIXDB_SECTION_NODES ? PREFIXDB_PAGE_SIZE : PREFIXDB_CACHELINE) - 1);
+        offsets[type]  = size;
+        size          += lengths[type];
+    }
+    db->data_size = size;
+    if (handle >= 0)
+    {
+        // blocks are reserved upfront, so that a full filesystem fails here instead of faulting while writing the mapping
+        if (ftruncate(handle, db->data_size) < 0 || posix_fallocate(handle, 0, db->data_size) ||
+            (db->data = (uint8_t *)mmap(NULL, db->data_size, PROT_READ | PROT_WRITE, MAP_SHARED, handle, 0)) == MAP_FAILED)
+        {
+            db->data = NULL;
+            return PREFIXDB_ERROR_ACCESS;
+        }
+        db->handle = handle;
+        db->flags  = (db->flags & ~PREFIXDB_FLAGS_COPY) | PREFIXDB_FLAGS_MMAP | PREFIXDB_FLAGS_SERIALIZED;
+    }
+    else
+    {
+        if (!(db->data = (uint8_t *)calloc(1, db->data_size)))
+        {
+            return PREFIXDB_ERROR_MEMORY;
+        }
+        db->flags = (db->flags & ~PREFIXDB_FLAGS_MMAP) | PREFIXDB_FLAGS_COPY | PREFIXDB_FLAGS_SERIALIZED;
+    }
+    db->version = db->skips_count ? PREFIXDB_LIBRARY_VERSION : PREFIXDB_SECTIONS_VERSION;
+    prefixdb_generation(db);
+    *((uint32_t *)(db->data))      = htonl(PREFIXDB_MAGIC_MARKER);
+    *((uint16_t *)(db->data + 4))  = htons(db->version);
+    *((uint8_t  *)(db->data + 6))  = (uint8_t)(db->records_size * 8);
+    *((uint32_t *)(db->data + 8))  = htonl(db->nodes_count);
+    *((uint32_t *)(db->data + 12)) = htonl(db->values_count);
+    *((uint32_t *)(db->data + 16)) = htonl(db->data_size);
+    *((uint32_t *)(db->data + 20)) = htonl(db->skips_count);
+    *((uint8_t  *)(db->data + 24)) = db->engine;
+    for (index = 0, count = 0; index < sizeof(sections); index ++)
+    {
+        type = sections[index];
+        if (lengths[type] || type == PREFIXDB_SECTION_NODES)
+        {
+            *((uint32_t *)(db->data + PREFIXDB_HEADER_SIZE + (count * 16)))     = htonl(type);
+            *((uint32_t *)(db->data + PREFIXDB_HEADER_SIZE + (count * 16) + 4)) = htonl(offsets[type]);
+            *((uint32_t *)(db->data + PREFIXDB_HEADER_SIZE + (count * 16) + 8)) = htonl(lengths[type]);
+            count ++;
+        }
+    }
+    *((uint8_t  *)(db->data + 7))  = (uint8_t)count;
+    db->lookup   = NULL;
+    db->records  = db->data + offsets[PREFIXDB_SECTION_NODES];
+    db->skips    = db->data + offsets[PREFIXDB_SECTION_SKIPS];
+    db->index    = db->data + offsets[PREFIXDB_SECTION_INDEX];
+    db->summary  = db->data + offsets[PREFIXDB_SECTION_SUMMARY];
+    db->checksum = db->data + offsets[PREFIXDB_SECTION_CHECKSUM];
+    for (count = 0; count < db->values_count; count ++)
+    {
+        *((uint32_t *)(db->data + offsets[PREFIXDB_SECTION_VALUES] + (count * 8)))     = htonl(db->values[count] >> 32);
+        *((uint32_t *)(db->data + offsets[PREFIXDB_SECTION_VALUES] + (count * 8) + 4)) = htonl(db->values[count] & 0xffffffff);
+    }
+    return PREFIXDB_ERROR_OK;
+}
+
+// top-level index, statistics summary, engine and checksum sections of a freshly written image
+static int prefixdb_seal(_PREFIXDB *db)
+{
+    uint32_t count;
+
+    for (count = 0; count < (1 << PREFIXDB_INDEX_LENGTH); count ++)
+    {
+        *((uint32_t *)(db->index + (count * 4))) = htonl(db->nodes_count);
+    }
+    if (db->nodes_count)
+    {
+        prefixdb_walk(db, 0, 0, 0, 0, prefixdb_index_fill, NULL);
+    }
+    prefixdb_summarize(db);
+    return prefixdb_engine_store(db);
+}
+
+// serialize the build trie into a new image, allocated in memory or (when handle is a file descriptor) mapped from that file,
+// so that saving a database never needs the whole image in anonymous memory
+static int prefixdb_serialize_into(_PREFIXDB *db, int handle)
+{
+    _PREFIXDB_NODE *pnode;
+    uint64_t       begin;
+    uint32_t       capacity = 0;
+    int            status;
+
+    if (db->flags & PREFIXDB_FLAGS_SERIALIZED)
+    {
+        return PREFIXDB_ERROR_OK;
+    }
+    begin = (db->flags & PREFIXDB_FLAGS_METRICS) ? prefixdb_clock() : 0;
+    db->pass += 5;
+    free(db->prefilter);
+    free(db->counters);
+    db->prefilter = NULL;
+    db->counters  = NULL;
+    prefixdb_engine_release(db);
+
+    // prefixes redux (pass 1)
+    pnode = &(db->nodes);
+    while (1)
+    {
+        if (pnode != &(db->nodes) &&
+            pnode->down[0] && !pnode->down[0]->down[0] && !pnode->down[0]->down[1] &&
+            pnode->down[1] && !pnode->down[1]->down[0] && !pnode->down[1]->down[1] && pnode->down[0]->tags == pnode->down[1]->tags)
+        {
+            pnode->tags = pnode->down[0]->tags;
+            prefixdb_node_release(db, pnode->down[0]);
+            prefixdb_node_release(db, pnode->down[1]);
+            pnode->down[0] = pnode->down[1] = NULL;
+        }
+        while (pnode->down[0] && pnode->explored[0] != (db->pass + 1))
+        {
+            pnode->explored[0] = (db->pass + 1);
+            pnode              = pnode->down[0];
+        }
+        if (pnode->down[1] && pnode->explored[1] != (db->pass + 1))
+        {
+            pnode->explored[1] = (db->pass + 1);
+            pnode              = pnode->down[1];
+            continue;
+        }
+        if (pnode == &(db->nodes))
+        {
+            break;
+        }
+        pnode = pnode->up;
+    }
+
+    // nodes numbering and leaves tags collection (pass 2)
+    pnode = &(db->nodes);
+    db->nodes_count = 0;
+    db->skips_count = 0;
+    free(db->values);
+    db->values       = NULL;
+    db->values_count = 0;
+    while (1)
+    {
+        if (pnode->flaggued != (db->pass + 1))
+        {
+            pnode->flaggued = (db->pass + 1);
+            pnode->id       = 0;
+            if (pnode->down[0] || pnode->down[1])
+            {
+                pnode->id = prefixdb_number(db, pnode);
+            }
+            else if (pnode->tags && prefixdb_collect_value(db, pnode->tags, &capacity) != PREFIXDB_ERROR_OK)
+            {
+                return PREFIXDB_ERROR_MEMORY;
+            }
+        }
+        while (pnode->down[0] && pnode->explored[0] != (db->pass + 2))
+        {
+            pnode->explored[0] = (db->pass + 2);
+            pnode              = pnode->down[0];
+            if (pnode->flaggued != (db->pass + 1))
+            {
+                pnode->flaggued = (db->pass + 1);
+                pnode->id       = 0;
+                if (pnode->down[0] || pnode->down[1])
+                {
+                    pnode->id = prefixdb_number(db, pnode);
+                }
+                else if (pnode->tags && prefixdb_collect_value(db, pnode->tags, &capacity) != PREFIXDB_ERROR_OK)
+                {
+                    return PREFIXDB_ERROR_MEMORY;
+                }
+            }
+        }
+        if (pnode->down[1] && pnode->explored[1] != (db->pass + 2))
+        {
+            pnode->explored[1] = (db->pass + 2);
+            pnode              = pnode->down[1];
+            continue;
+        }
+        if (pnode == &(db->nodes))
+        {
+            break;
+        }
+        pnode = pnode->up;
+    }
+
+    prefixdb_values_sort(db);
+
+    if (db->data)
+    {
+        if (db->flags & PREFIXDB_FLAGS_COPY)
+        {
+            free(db->data);
+        }
+        else if (db->flags & PREFIXDB_FLAGS_MMAP)
+        {
+            munmap(db->data, db->data_size);
+            close(db->handle);
+        }
+    }
+    db->data    = db->records = db->skips = db->index = db->summary = db->checksum = NULL;
+    if ((status = prefixdb_layout(db, handle)) != PREFIXDB_ERROR_OK)
+    {
+        return status;
+    }
+
+    // nodes writing (pass 3)
+    pnode = &(db->nodes);
+    while (1)
+    {
+        if (pnode->flaggued != (db->pass + 2) && (pnode->down[0] || pnode->down[1]))
+        {
+            pnode->flaggued = (db->pass + 2);
+            prefixdb_write_trie_node(db, pnode);
+        }
+        while (pnode->down[0] && pnode->explored[0] != (db->pass + 3))
+        {
+            pnode->explored[0] = (db->pass + 3);
+            pnode              = pnode->down[0];
+            if (pnode->flaggued != (db->pass + 2) && (pnode->down[0] || pnode->down[1]))
+            {
+                pnode->flaggued = (db->pass + 2);
+                prefixdb_write_trie_node(db, pnode);
+            }
+        }
+        if (pnode->down[1] && pnode->explored[1] != (db->pass + 3))
+        {
+            pnode->explored[1] = (db->pass + 3);
+            pnode              = pnode->down[1];
+            continue;
+        }
+        if (pnode == &(db->nodes))
+        {
+            break;
+        }
+        pnode = pnode->up;
+    }
+
+    // top-level index, statistics summary, engine and checksum sections
+    if ((status = prefixdb_seal(db)) != PREFIXDB_ERROR_OK)
+    {
+        return status;
+    }
+    if ((status = prefixdb_options(db)) == PREFIXDB_ERROR_OK && (db->flags & PREFIXDB_FLAGS_METRICS))
+    {
+        prefixdb_histogram_add(&(prefixdb_metrics_shard(db)->serializations), prefixdb_clock() - begin);
+    }
+    return status;
+}
+
+static int prefixdb_serialize(_PREFIXDB *db)
+{
+    return prefixdb_serialize_into(db, -1);
+}
+
+int prefixdb_save_binary(PREFIXDB *_db, uint8_t **data, uint32_t *size, uint8_t flags)
+{
+    _PREFIXDB *db = (_PREFIXDB *)_db;
+
+    if (!db || prefixdb_serialize(db) != PREFIXDB_ERROR_OK)
+    {
+        return PREFIXDB_ERROR_PARAM;
+    }
+    if (data)
+    {
+        if (flags & PREFIXDB_FLAGS_COPY)
+        {
+            if (!(*data = (uint8_t *)malloc(db->data_size)))
+            {
+                return PREFIXDB_ERROR_MEMORY;
+            }
+            memcpy(*data, db->data, db->data_size);
+        }
+        else
+        {
+            *data = db->data;
+        }
+    }
+    if (size) *size = db->data_size;
+    return (flags & PREFIXDB_FLAGS_FREEZE) ? prefixdb_freeze(db) : PREFIXDB_ERROR_OK;
+}
+
+// release the build trie once the image exists, halving the memory of databases only searched from then on (adding more
+// prefixes later rebuilds it from the image)
+int prefixdb_freeze(PREFIXDB *_db)
+{
+    _PREFIXDB *db = (_PREFIXDB *)_db;
+
+    if (!db || prefixdb_serialize(db) != PREFIXDB_ERROR_OK)
+    {
+        return PREFIXDB_ERROR_PARAM;
+    }
+    prefixdb_chunks_release(db);
+    db->flags |= PREFIXDB_FLAGS_FREEZE;
+    return PREFIXDB_ERROR_OK;
+}
+
+static int prefixdb_sync_directory(const char *path)
+{
+    char *directory, *separator;
+    int  handle, status = PREFIXDB_ERROR_ACCESS;
+
+    if (!(directory = strdup(path)))
+    {
+        return PREFIXDB_ERROR_MEMORY;
+    }
+    if ((separator = strrchr(directory, '/')))
+    {
+        *(separator == directory ? separator + 1 : separator) = 0;
+    }
+    if ((handle = open(separator ? directory : ".", O_RDONLY)) >= 0)
+    {
+        status = fsync(handle) < 0 ? PREFIXDB_ERROR_ACCESS : PREFIXDB_ERROR_OK;
+        close(handle);
+    }
+    free(directory);
+    return status;
+}
+
+// the image goes to a temporary file next to path, which is fsync'ed and then renamed over path: readers opening or mapping
+// path only ever see a complete image (the previous one or the new one); databases not serialized yet are serialized straight
+// into the temporary file mapping (which is made read-only once sealed, and dropped if the save fails), and already serialized
+// ones are written out with large sequential writes
+int prefixdb_save_file(PREFIXDB *_db, const char *path)
+{
+    _PREFIXDB   *db = (_PREFIXDB *)_db;
+    struct stat info;
+    char        *temporary;
+    uint32_t    offset;
+    ssize_t     written;
+    mode_t      mode, mask;
+    int         handle, owned = 0, status = PREFIXDB_ERROR_OK;
+
+    if (!db || !path)
+    {
+        return PREFIXDB_ERROR_PARAM;
+    }
+    if (!(temporary = (char *)malloc(strlen(path) + 8)))
+    {
+        return PREFIXDB_ERROR_MEMORY;
+    }
+    sprintf(temporary, "%s.XXXXXX", path);
+    if ((handle = mkstemp(temporary)) < 0)
+    {
+        free(temporary);
+        return PREFIXDB_ERROR_ACCESS;
+    }
+
+    // an existing database keeps its mode, a new one gets the mode fopen() would have created it with (mkstemp() uses 0600)
+    if (stat(path, &info) == 0)
+    {
+        mode = info.st_mode & 07777;
+    }
+    else
+    {
+        mask = umask(0);
+        umask(mask);
+        mode = 0666 & ~mask;
+    }
+    fchmod(handle, mode);
+    if (!(db->flags & PREFIXDB_FLAGS_SERIALIZED))
+    {
+        status = prefixdb_serialize_into(db, handle);
+        owned  = db->data && (db->flags & PREFIXDB_FLAGS_MMAP) && db->handle == handle;
+
+        // the sealed image becomes read-only, so that nothing can write through the mapping into the published file
+        if (status == PREFIXDB_ERROR_OK && (msync(db->data, db->data_size, MS_SYNC) < 0 || mprotect(db->data, db->data_size, PROT_READ) < 0))
+        {
+            status = PREFIXDB_ERROR_ACCESS;
+        }
+    }
+    else
+    {
+        for (offset = 0; offset < db->data_size; offset += written)
+        {
+            if ((written = write(handle, db->data + offset, (db->data_size - offset) < (1 << 20) ? (db->data_size - offset) : (1 << 20))) <= 0)
+            {
+                status = PREFIXDB_ERROR_ACCESS;
+                break;
+            }
+        }
+    }
+    if (status == PREFIXDB_ERROR_OK && (fsync(handle) < 0 || rename(temporary, path) < 0))
+    {
+        status = PREFIXDB_ERROR_ACCESS;
+    }
+    if (status != PREFIXDB_ERROR_OK)
+    {
+        unlink(temporary);
+
+        // a failed save leaves the database unserialized (searched from its build trie) rather than mapped onto the
+        // unlinked temporary file
+        if (owned)
+        {
+            prefixdb_engine_release(db);
+            munmap(db->data, db->data_size);
+            db->data   = db->records = db->skips = db->index = db->summary = db->checksum = db->lookup = NULL;
+            db->handle = -1;
+            db->flags &= ~(PREFIXDB_FLAGS_MMAP | PREFIXDB_FLAGS_SERIALIZED);
+            owned      = 0;
+        }
+    }
+    else
+    {
+        status = prefixdb_sync_directory(path);
+    }
+    if (!owned)
+    {
+        close(handle);
+    }
+    free(temporary);
+    return status;
+}
+
+static inline int prefixdb_lookup(_PREFIXDB *db, uint32_t address, uint8_t *depth, uint32_t *value)
+{
+    uint32_t next = 0;
+    int8_t   bit  = 31;
+    int      status;
+
+    if (db->index)
+    {
+        next   = ntohl(*(uint32_t *)(db->index + ((address >> (32 - PREFIXDB_INDEX_LENGTH)) * 4)));
+        bit    = 31 - PREFIXDB_INDEX_LENGTH;
+        *depth = 1;
+    }
+    while ((status = prefixdb_step(db, address, &next, &bit)) < 0)
+    {
+        (*depth) ++;
+    }
+    if (status == PREFIXDB_ERROR_OK)
+    {
+        *value = next;
+    }
+    return status;
+}
+
+// lookups counting hits also return the slot of the record the leaf was read from (leaves found straight in the index, which
+// only hold prefixes shorter than the index length, are looked up again from the root to find it)
+static inline int prefixdb_lookup_counted(_PREFIXDB *db, uint32_t address, uint8_t *depth, uint32_t *value, uint32_t *slot)
+{
+    uint32_t next = 0;
+    int8_t   bit  = 31;
+    int      status;
+
+    *slot = PREFIXDB_NO_SLOT;
+    if (db->index)
+    {
+        next   = ntohl(*(uint32_t *)(db->index + ((address >> (32 - PREFIXDB_INDEX_LENGTH)) * 4)));
+        bit    = 31 - PREFIXDB_INDEX_LENGTH;
+        *depth = 1;
+    }
+    while (1)
+    {
+        if (next < db->nodes_count)
+        {
+            *slot = (next * 2) + (bit >= 0 ? (address >> bit) & 1 : 0);
+        }
+        else if (prefixdb_is_skip(db, next))
+        {
+            *slot = (db->nodes_count * 2) + (next - prefixdb_skips_base(db));
+        }
+        if ((status = prefixdb_step(db, address, &next, &bit)) >= 0)
+        {
+            if (status != PREFIXDB_ERROR_OK || *slot != PREFIXDB_NO_SLOT)
+            {
+                break;
+            }
+            next = 0;
+            bit  = 31;
+        }
+        (*depth) ++;
+    }
+    if (status == PREFIXDB_ERROR_OK)
+    {
+        *value = next;
+    }
+    return status;
+}
+
+static inline int prefixdb_search(_PREFIXDB *db, uint32_t address, uint8_t *depth, uint32_t *value)
+{
+    _PREFIXDB_CACHE_ENTRY *entry = NULL;
+    uint32_t              slot   = PREFIXDB_NO_SLOT;
+    int                   status;
+
+    *depth = 0;
+    if (db->prefilter)
+    {
+        PREFIXDB_COUNT(prefixdb_shard(db)->prefilter_checked);
+        if (!(db->prefilter[address >> 19] & (1 << ((address >> 16) % 8))))
+        {
+            PREFIXDB_COUNT(prefixdb_shard(db)->prefilter_rejected);
+            return PREFIXDB_ERROR_NOTFOUND;
+        }
+    }
+    if ((db->flags & PREFIXDB_FLAGS_CACHE) && (entry = prefixdb_cache_entry(address)))
+    {
+        if (entry->generation == db->generation && entry->address == address)
+        {
+            PREFIXDB_COUNT(prefixdb_shard(db)->cache_hits);
+            if (db->counters && entry->slot != PREFIXDB_NO_SLOT)
+            {
+                PREFIXDB_HIT(db->counters[entry->slot]);
+            }
+            *value = entry->value;
+            return entry->value ? PREFIXDB_ERROR_OK : PREFIXDB_ERROR_NOTFOUND;
+        }
+        PREFIXDB_COUNT(prefixdb_shard(db)->cache_misses);
+    }
+    if (db->counters)
+    {
+        if ((status = prefixdb_lookup_counted(db, address, depth, value, &slot)) == PREFIXDB_ERROR_OK)
+        {
+            PREFIXDB_HIT(db->counters[slot]);
+        }
+    }
+    else
+    {
+        status = db->hash ? prefixdb_hash_lookup(db, address, depth, value) :
+                 db->intervals ? prefixdb_intervals_lookup(db, address, depth, value) : prefixdb_lookup(db, address, depth, value);
+    }
+    if (entry && status != PREFIXDB_ERROR_PARAM)
+    {
+        entry->address    = address;
+        entry->generation = db->generation;
+        entry->value      = (status == PREFIXDB_ERROR_OK) ? *value : 0;
+        entry->slot       = (status == PREFIXDB_ERROR_OK) ? slot : PREFIXDB_NO_SLOT;
+    }
+    return status;
+}
+
+// lookups on a modified database walk the build trie directly instead of serializing it again (the image is only rebuilt
+// when explicitly saved or frozen, or when image-based statistics are requested)
+static inline int prefixdb_search_trie(_PREFIXDB *db, uint32_t address, uint8_t *depth, uint64_t *tags)
+{
+    _PREFIXDB_NODE *pnode = &(db->nodes);
+    int8_t         bit    = 31;
+
+    *depth = 0;
+    while (pnode->down[0] || pnode->down[1])
+    {
+        if (bit < 0)
+        {
+            return PREFIXDB_ERROR_PARAM;
+        }
+        if (!(pnode = pnode->down[(address >> bit) & 1]))
+        {
+            return PREFIXDB_ERROR_NOTFOUND;
+        }
+        bit --;
+        (*depth) ++;
+    }
+    if (!pnode->tags)
+    {
+        return PREFIXDB_ERROR_NOTFOUND;
+    }
+    if (tags)
+    {
+        *tags = pnode->tags;
+    }
+    return PREFIXDB_ERROR_OK;
+}
+
+static inline int prefixdb_search_tags(_PREFIXDB *db, uint32_t address, uint8_t *depth, uint64_t *tags)
+{
+    uint32_t value;
+    int      status;
+
+    if (!(db->flags & PREFIXDB_FLAGS_SERIALIZED))
+    {
+        return prefixdb_search_trie(db, address, depth, tags);
+    }
+    if ((status = prefixdb_search(db, address, depth, &value)) == PREFIXDB_ERROR_OK && tags)
+    {
+        *tags = prefixdb_value_tags(db, value);
+    }
+    return status;
+}
+
+static int prefixdb_search_measured(_PREFIXDB *db, uint32_t address, uint64_t *tags)
+{
+    PREFIXDBMETRICS *metrics;
+    uint64_t        begin;
+    uint8_t         depth;
+    int             status;
+
+    if (!db)
+    {
+        return PREFIXDB_ERROR_PARAM;
+    }
+    if (!(db->flags & PREFIXDB_FLAGS_METRICS))
+    {
+        return prefixdb_search_tags(db, address, &depth, tags);
+    }
+    begin   = prefixdb_clock();
+    status  = prefixdb_search_tags(db, address, &depth, tags);
+    metrics = prefixdb_metrics_shard(db);
+    prefixdb_histogram_add(&(metrics->searches), prefixdb_clock() - begin);
+    PREFIXDB_ADD(metrics->depths, depth);
+    if (status == PREFIXDB_ERROR_OK)
+    {
+        PREFIXDB_COUNT(metrics->matches);
+    }
+    return status;
+}
+
+int prefixdb_search_binary(PREFIXDB *_db, uint32_t address, PREFIXDBINFO **_info)
+{
+    return prefixdb_search_measured((_PREFIXDB *)_db, address, NULL);
+}
+
+int prefixdb_search_binary_tagged(PREFIXDB *_db, uint32_t address, uint64_t *tags)
+{
+    if (tags)
+    {
+        *tags = 0;
+    }
+    return prefixdb_search_measured((_PREFIXDB *)_db, address, tags);
+}
+
+int prefixdb_search_string(PREFIXDB *_db, const char *_address, PREFIXDBINFO **_info)
+{
+    return prefixdb_search_string_tagged(_db, _address, NULL);
+}
+
+int prefixdb_search_string_tagged(PREFIXDB *_db, const char *_address, uint64_t *tags)
+{
+    struct in_addr address;
+
+    if (!_address || !inet_aton(_address, &address))
+    {
+        return PREFIXDB_ERROR_PARAM;
+    }
+    return prefixdb_search_binary_tagged(_db, htonl(address.s_addr), tags);
+}
+
+// walk up to PREFIXDB_BATCH_SIZE tries in lockstep, prefetching the next node of each, so that their memory loads overlap
+int prefixdb_search_binary_batch(PREFIXDB *_db, const uint32_t *addresses, uint32_t count, uint8_t *results)
+{
+    _PREFIXDB *db = (_PREFIXDB *)_db;
+    uint32_t  base, lanes, lane, active, nexts[PREFIXDB_BATCH_SIZE];
+    int8_t    bits[PREFIXDB_BATCH_SIZE];
+    int       status;
+
+    if (!db || !addresses || !results)
+    {
+        return PREFIXDB_ERROR_PARAM;
+    }
+    if ((db->flags & (PREFIXDB_FLAGS_CACHE | PREFIXDB_FLAGS_METRICS | PREFIXDB_FLAGS_COUNTERS)) || !(db->flags & PREFIXDB_FLAGS_SERIALIZED) ||
+        db->engine != PREFIXDB_ENGINE_TRIE)
+    {
+        for (lane = 0; lane < count; lane ++)
+        {
+            results[lane] = prefixdb_search_binary(db, addresses[lane], NULL);
+        }
+        return PREFIXDB_ERROR_OK;
+    }
+    for (base = 0; base < count; base += PREFIXDB_BATCH_SIZE)
+    {
+        lanes  = (count - base) < PREFIXDB_BATCH_SIZE ? (count - base) : PREFIXDB_BATCH_SIZE;
+        active = 0;
+        for (lane = 0; lane < lanes; lane ++)
+        {
+            results[base + lane] = PREFIXDB_ERROR_PARAM;
+            if (db->prefilter)
+            {
+                PREFIXDB_COUNT(prefixdb_shard(db)->prefilter_checked);
+                if (!(db->prefilter[addresses[base + lane] >> 19] & (1 << ((addresses[base + lane] >> 16) % 8))))
+                {
+                    PREFIXDB_COUNT(prefixdb_shard(db)->prefilter_rejected);
+                    results[base + lane] = PREFIXDB_ERROR_NOTFOUND;
+                    continue;
+                }
+            }
+            nexts[lane] = 0;
+            bits[lane]  = 31;
+            if (db->index)
+            {
+                nexts[lane] = ntohl(*(uint32_t *)(db->index + ((addresses[base + lane] >> (32 - PREFIXDB_INDEX_LENGTH)) * 4)));
+                bits[lane]  = 31 - PREFIXDB_INDEX_LENGTH;
+                prefixdb_prefetch(db, nexts[lane]);
+            }
+            active |= (1 << lane);
+        }
+
+        // each round moves all active lanes one dependent load further (skip entries let them run at different bits)
+        while (active)
+        {
+            for (lane = 0; lane < lanes; lane ++)
+            {
+                if (active & (1 << lane))
+                {
+                    if ((status = prefixdb_step(db, addresses[base + lane], nexts + lane, bits + lane)) >= 0)
+                    {
+                        results[base + lane] = status;
+                        active &= ~(1 << lane);
+                        continue;
+                    }
+                    prefixdb_prefetch(db, nexts[lane]);
+                }
+            }
+        }
+    }
+    return PREFIXDB_ERROR_OK;
+}
+
+typedef struct
+{
+    PREFIXDBHITS *top;
+    uint32_t     size, count;
+} _PREFIXDB_TOP;
+
+static void prefixdb_top_sift(PREFIXDBHITS *top, uint32_t count, uint32_t index)
+{
+    PREFIXDBHITS swap;
+    uint32_t     smallest;
+
+    while (1)
+    {
+        smallest = index;
+        if ((index * 2) + 1 < count && top[(index * 2) + 1].hits < top[smallest].hits) smallest = (index * 2) + 1;
+        if ((index * 2) + 2 < count && top[(index * 2) + 2].hits < top[smallest].hits) smallest = (index * 2) + 2;
+        if (smallest == index)
+        {
+            break;
+        }
+        swap          = top[index];
+        top[index]    = top[smallest];
+        top[smallest] = swap;
+        index         = smallest;
+    }
+}
+
+// keep the most hit leaves in a min-heap (the least hit of them on top)
+static int prefixdb_top_walk(_PREFIXDB *db, uint32_t address, uint8_t length, uint8_t depth, uint32_t value, void *context)
+{
+    _PREFIXDB_TOP *top = (_PREFIXDB_TOP *)context;
+    PREFIXDBHITS  swap, hits;
+    uint32_t      slot, index;
+
+    if (value < db->nodes_count || prefixdb_is_skip(db, value))
+    {
+        return 1;
+    }
+    if (value > db->nodes_count && prefixdb_lookup_counted(db, address, &depth, &value, &slot) == PREFIXDB_ERROR_OK &&
+        (hits.hits = __atomic_load_n(db->counters + slot, __ATOMIC_RELAXED)))
+    {
+        hits.address = address;
+        hits.length  = length;
+        hits.tags    = prefixdb_value_tags(db, value);
+        if (top->count < top->size)
+        {
+            top->top[index = top->count ++] = hits;
+            while (index && top->top[(index - 1) / 2].hits > top->top[index].hits)
+            {
+                swap                       = top->top[index];
+                top->top[index]            = top->top[(index - 1) / 2];
+                top->top[(index - 1) / 2]  = swap;
+                index                      = (index - 1) / 2;
+            }
+        }
+        else if (hits.hits > top->top[0].hits)
+        {
+            top->top[0] = hits;
+            prefixdb_top_sift(top->top, top->count, 0);
+        }
+    }
+    return 0;
+}
+
+static int prefixdb_top_compare(const void *first, const void *second)
+{
+    const PREFIXDBHITS *left = (const PREFIXDBHITS *)first, *right = (const PREFIXDBHITS *)second;
+
+    if (left->hits != right->hits)
+    {
+        return left->hits > right->hits ? -1 : 1;
+    }
+    return left->address < right->address ? -1 : (left->address > right->address ? 1 : 0);
+}
+
+// the (up to) size stored prefixes with the most hits since counters were enabled or reset, most hit first (prefixes never
+// hit are not reported)
+int prefixdb_counters_top(PREFIXDB *_db, PREFIXDBHITS *hits, uint32_t size, uint32_t *count)
+{
+    _PREFIXDB     *db = (_PREFIXDB *)_db;
+    _PREFIXDB_TOP top;
+
+    if (!db || !hits || !count)
+    {
+        return PREFIXDB_ERROR_PARAM;
+    }
+    *count = 0;
+    if (!db->counters)
+    {
+        return PREFIXDB_ERROR_NOTFOUND;
+    }
+    top.top   = hits;
+    top.size  = size;
+    top.count = 0;
+    if (size && db->nodes_count)
+    {
+        prefixdb_walk(db, 0, 0, 0, 0, prefixdb_top_walk, &top);
+    }
+    qsort(hits, top.count, sizeof(PREFIXDBHITS), prefixdb_top_compare);
+    *count = top.count;
+    return PREFIXDB_ERROR_OK;
+}
+
+int prefixdb_counters_reset(PREFIXDB *_db)
+{
+    _PREFIXDB *db = (_PREFIXDB *)_db;
+    uint32_t  index;
+
+    if (!db)
+    {
+        return PREFIXDB_ERROR_PARAM;
+    }
+    if (!db->counters)
+    {
+        return PREFIXDB_ERROR_NOTFOUND;
+    }
+    for (index = 0; index <= prefixdb_counters_count(db); index ++)
+    {
+        __atomic_store_n(db->counters + index, 0, __ATOMIC_RELAXED);
+    }
+    return PREFIXDB_ERROR_OK;
+}
+
+typedef struct
+{
+    PREFIXDBOVERLAP callback;
+    void            *context;
+    uint8_t         found, stopped;
+} _PREFIXDB_OVERLAP;
+
+static int prefixdb_overlap_walk(_PREFIXDB *db, uint32_t address, uint8_t length, uint8_t depth, uint32_t value, void *context)
+{
+    _PREFIXDB_OVERLAP *overlap = (_PREFIXDB_OVERLAP *)context;
+
+    if (value < db->nodes_count || prefixdb_is_skip(db, value))
+    {
+        return 1;
+    }
+    if (value > db->nodes_count)
+    {
+        overlap->found = 1;
+        if (overlap->callback && overlap->callback(address, length, prefixdb_value_tags(db, value), overlap->context))
+        {
+            overlap->stopped = 1;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// stored prefixes overlapping address/length (0 for the whole address space): the serialized trie is only descended along the
+// queried prefix path (where a leaf is the single stored prefix covering it), then walked below it (each leaf being a stored
+// prefix lying inside it); prefixes are reported as stored in the image (adjacent prefixes with the same lists merged), and
+// the callback returns non-zero to stop the enumeration
+int prefixdb_overlap_binary(PREFIXDB *_db, uint32_t address, uint8_t length, uint8_t *overlaps, PREFIXDBOVERLAP callback, void *context)
+{
+    _PREFIXDB         *db = (_PREFIXDB *)_db;
+    _PREFIXDB_OVERLAP overlap;
+    uint32_t          next = 0;
+    uint8_t           *entry, current = 0;
+    int               status = 0;
+
+    if (overlaps)
+    {
+        *overlaps = 0;
+    }
+    if (!db || length > 32 || prefixdb_serialize(db) != PREFIXDB_ERROR_OK)
+    {
+        return PREFIXDB_ERROR_PARAM;
+    }
+    if (!db->nodes_count)
+    {
+        return PREFIXDB_ERROR_NOTFOUND;
+    }
+    memset(&overlap, 0, sizeof(overlap));
+    overlap.callback = callback;
+    overlap.context  = context;
+    address         &= PREFIXDB_PREFIX_MASK(length);
+    while (1)
+    {
+        if (prefixdb_is_skip(db, next))
+        {
+            if (!(entry = prefixdb_skip_entry(db, next)) || entry[4] <= current || entry[4] > 32)
+            {
+                return PREFIXDB_ERROR_PARAM;
+            }
+            if ((address ^ prefixdb_skip_prefix(entry)) & PREFIXDB_PREFIX_MASK(entry[4] < length ? entry[4] : length))
+            {
+                return PREFIXDB_ERROR_NOTFOUND;
+            }
+            if (entry[4] > length)
+            {
+                status = prefixdb_walk_skip(db, next, current, current, prefixdb_overlap_walk, &overlap);
+                break;
+            }
+            next    = prefixdb_read_record(db, entry + 5);
+            current = entry[4];
+            continue;
+        }
+        if (current >= length || next >= db->nodes_count)
+        {
+            break;
+        }
+        next = prefixdb_read_record(db, db->records + (next * (db->records_size * 2)) + (((address >> (31 - current)) & 1) ? db->records_size : 0));
+        current ++;
+    }
+    if (next == db->nodes_count)
+    {
+        return PREFIXDB_ERROR_NOTFOUND;
+    }
+    if (next > db->nodes_count && !prefixdb_is_skip(db, next))
+    {
+        if (overlaps)
+        {
+            *overlaps = PREFIXDB_OVERLAP_COVERED;
+        }
+        if (callback)
+        {
+            callback(address & PREFIXDB_PREFIX_MASK(current), current, prefixdb_value_tags(db, next), context);
+        }
+        return PREFIXDB_ERROR_OK;
+    }
+    if (next < db->nodes_count && current == length)
+    {
+        status = (length < 32) ? prefixdb_walk(db, next, address, length, length, prefixdb_overlap_walk, &overlap) : -1;
+    }
+    if (status < 0 && !overlap.stopped)
+    {
+        return PREFIXDB_ERROR_PARAM;
+    }
+    if (overlaps && overlap.found)
+    {
+        *overlaps = PREFIXDB_OVERLAP_INSIDE;
+    }
+    return overlap.found ? PREFIXDB_ERROR_OK : PREFIXDB_ERROR_NOTFOUND;
+}
+
+int prefixdb_overlap_string(PREFIXDB *_db, const char *prefix, uint8_t *overlaps, PREFIXDBOVERLAP callback, void *context)
+{
+    uint32_t address;
+    uint8_t  length;
+
+    if (overlaps)
+    {
+        *overlaps = 0;
+    }
+    if (!prefix || !*prefix || prefixdb_parse_prefix(prefix, strlen(prefix), &address, &length) != (int)strlen(prefix))
+    {
+        return PREFIXDB_ERROR_PARAM;
+    }
+    return prefixdb_overlap_binary(_db, address, length, overlaps, callback, context);
+}
+
+typedef struct
+{
+    uint64_t tags, total, *buckets;
+    uint32_t address;
+    uint8_t  length, breakdown;
+} _PREFIXDB_COVERAGE;
+
+static int prefixdb_coverage_count(uint32_t address, uint8_t length, uint64_t tags, void *context)
+{
+    _PREFIXDB_COVERAGE *coverage = (_PREFIXDB_COVERAGE *)context;
+    uint32_t           bucket, count;
+
+    if (coverage->tags && !(tags & coverage->tags))
+    {
+        return 0;
+    }
+    if (length < coverage->length)
+    {
+        address = coverage->address;
+        length  = coverage->length;
+    }
+    coverage->total += (uint64_t)1 << (32 - length);
+    if (coverage->buckets)
+    {
+        if (length >= coverage->breakdown)
+        {
+            coverage->buckets[address >> (32 - coverage->breakdown)] += (uint64_t)1 << (32 - length);
+        }
+        else
+        {
+            for (bucket = address >> (32 - coverage->breakdown), count = 1 << (coverage->breakdown - length); count; count --, bucket ++)
+            {
+                coverage->buckets[bucket] += (uint64_t)1 << (32 - coverage->breakdown);
+            }
+        }
+    }
+    return 0;
+}
+
+// number of addresses covered inside address/length (0 for the whole address space) by the stored prefixes belonging to any
+// of the tags lists (0 for all), optionally broken down into the 1 << breakdown buckets of the /breakdown prefixes (up to /16)
+// in a single walk over the serialized trie
+int prefixdb_coverage(PREFIXDB *_db, uint32_t address, uint8_t length, uint64_t tags, uint64_t *total, uint8_t breakdown, uint64_t *buckets)
+{
+    _PREFIXDB_COVERAGE coverage;
+    int                status;
+
+    if (!total || length > 32 || (buckets && (!breakdown || breakdown > 16)))
+    {
+        return PREFIXDB_ERROR_PARAM;
+    }
+    memset(&coverage, 0, sizeof(coverage));
+    coverage.tags      = tags;
+    coverage.address   = address & PREFIXDB_PREFIX_MASK(length);
+    coverage.length    = length;
+    coverage.breakdown = breakdown;
+    if ((coverage.buckets = buckets))
+    {
+        memset(buckets, 0, ((size_t)1 << breakdown) * sizeof(uint64_t));
+    }
+    if ((status = prefixdb_overlap_binary(_db, address, length, NULL, prefixdb_coverage_count, &coverage)) == PREFIXDB_ERROR_PARAM)
+    {
+        return status;
+    }
+    *total = coverage.total;
+    return PREFIXDB_ERROR_OK;
+}
+
+typedef struct
+{
+    uint64_t tags;
+    uint32_t address;
+    uint8_t  length;
+} _PREFIXDB_LEAF;
+
+typedef struct
+{
+    _PREFIXDB_LEAF *leaves;
+    uint32_t       count, size;
+} _PREFIXDB_LEAVES;
+
+static int prefixdb_leaves_walk(_PREFIXDB *db, uint32_t address, uint8_t length, uint8_t depth, uint32_t value, void *context)
+{
+    _PREFIXDB_LEAVES *leaves = (_PREFIXDB_LEAVES *)context;
+    _PREFIXDB_LEAF   *grown;
+
+    if (value < db->nodes_count || prefixdb_is_skip(db, value))
+    {
+        return 1;
+    }
+    if (value > db->nodes_count)
+    {
+        if (leaves->count >= leaves->size)
+        {
+            if (!(grown = (_PREFIXDB_LEAF *)realloc(leaves->leaves, (leaves->size ? leaves->size * 2 : 1024) * sizeof(_PREFIXDB_LEAF))))
+            {
+                return -1;
+            }
+            leaves->leaves = grown;
+            leaves->size   = leaves->size ? leaves->size * 2 : 1024;
+        }
+        leaves->leaves[leaves->count].address = address;
+        leaves->leaves[leaves->count].length  = length;
+        leaves->leaves[leaves->count ++].tags = prefixdb_value_tags(db, value);
+    }
+    return 0;
+}
+
+// the (disjoint) leaves of an image, ordered by address
+static int prefixdb_leaves(_PREFIXDB *db, _PREFIXDB_LEAVES *leaves)
+{
+    memset(leaves, 0, sizeof(_PREFIXDB_LEAVES));
+    if (prefixdb_serialize(db) != PREFIXDB_ERROR_OK)
+    {
+        return PREFIXDB_ERROR_PARAM;
+    }
+    if (db->nodes_count && prefixdb_walk(db, 0, 0, 0, 0, prefixdb_leaves_walk, leaves) < 0)
+    {
+        free(leaves->leaves);
+        return PREFIXDB_ERROR_MEMORY;
+    }
+    return PREFIXDB_ERROR_OK;
+}
+
+// big-endian fields of delta files (entries are not aligned)
+static void prefixdb_put_field(uint8_t *output, uint64_t value, uint8_t size)
+{
+    while (size)
+    {
+        output[-- size] = value & 0xff;
+        value         >>= 8;
+    }
+}
+
+static uint64_t prefixdb_get_field(const uint8_t *input, uint8_t size)
+{
+    uint64_t value = 0;
+
+    while (size --)
+    {
+        value = (value << 8) | *(input ++);
+    }
+    return value;
+}
+
+// write the delta entries of the leaves found in first but not in second (both ordered by address), returning their count
+static uint32_t prefixdb_leaves_missing(const _PREFIXDB_LEAVES *first, const _PREFIXDB_LEAVES *second, uint8_t *output)
+{
+    _PREFIXDB_LEAF *leaf, *other;
+    uint32_t       index, position = 0, count = 0;
+
+    for (index = 0; index < first->count; index ++)
+    {
+        leaf = first->leaves + index;
+        while (position < second->count && (second->leaves[position].address < leaf->address ||
+               (second->leaves[position].address == leaf->address && second->leaves[position].length < leaf->length)))
+        {
+            position ++;
+        }
+        other = (position < second->count) ? second->leaves + position : NULL;
+        if (other && other->address == leaf->address && other->length == leaf->length && other->tags == leaf->tags)
+        {
+            continue;
+        }
+        prefixdb_put_field(output, leaf->address, 4);
+        output[4] = leaf->length;
+        prefixdb_put_field(output + 5, leaf->tags, 8);
+        output += PREFIXDB_DELTA_ENTRY;
+        count ++;
+    }
+    return count;
+}
+
+// identity of an image in deltas: the checksum of the bytes covered by its checksum section (hashing that section too would
+// always fold to zero), or of the whole image when it has none
+static uint64_t prefixdb_image_checksum(_PREFIXDB *db)
+{
+    return prefixdb_checksum(db->data, db->checksum ? db->checksum - db->data : db->data_size);
+}
+
+// tree of a database being patched: only the paths of the changed leaves are materialized as patch nodes (leaves being those
+// with lists), every other subtree being referenced by its base image record value (the base nodes count for an empty branch)
+typedef struct __PREFIXDB_PATCH
+{
+    struct __PREFIXDB_PATCH *down[2];
+    uint64_t                tags;
+    uint32_t                values[2];
+} _PREFIXDB_PATCH;
+
+typedef struct
+{
+    _PREFIXDB *base, image;
+    uint64_t  *tags;
+    uint32_t  tags_count, nodes, skips;
+    uint8_t   *used, plain, write;
+} _PREFIXDB_PATCHING;
+
+static inline int prefixdb_patch_empty(_PREFIXDB *base, _PREFIXDB_PATCH *node, uint32_t value)
+{
+    return !node && value == base->nodes_count;
+}
+
+static inline int prefixdb_patch_leaf(_PREFIXDB *base, _PREFIXDB_PATCH *node, uint32_t value)
+{
+    return node ? node->tags != 0 : (value > base->nodes_count && !prefixdb_is_skip(base, value));
+}
+
+// children of an internal node of the patched tree found at length: a patch node, a base image node or a base image skip
+// entry (standing for each single-child node of its chain in turn, down to the record ending it)
+static void prefixdb_patch_children(_PREFIXDB *base, _PREFIXDB_PATCH *node, uint32_t value, uint8_t length, _PREFIXDB_PATCH **down, uint32_t *values)
+{
+    uint8_t *entry, bit;
+
+    down[0]   = node ? node->down[0] : NULL;
+    down[1]   = node ? node->down[1] : NULL;
+    values[0] = node ? node->values[0] : base->nodes_count;
+    values[1] = node ? node->values[1] : base->nodes_count;
+    if (node || length >= 32)
+    {
+        return;
+    }
+    if (value < base->nodes_count)
+    {
+        values[0] = prefixdb_read_record(base, base->records + (value * 2 * base->records_size));
+        values[1] = prefixdb_read_record(base, base->records + (value * 2 * base->records_size) + base->records_size);
+    }
+    else if (prefixdb_is_skip(base, value) && (entry = prefixdb_skip_entry(base, value)) && entry[4] > length && entry[4] <= 32)
+    {
+        bit         = (prefixdb_skip_prefix(entry) >> (31 - length)) & 1;
+        values[bit] = (entry[4] == length + 1) ? prefixdb_read_record(base, entry + 5) : value;
+    }
+}
+
+static int prefixdb_patch_single(_PREFIXDB *base, _PREFIXDB_PATCH *node, uint32_t value, uint8_t length)
+{
+    _PREFIXDB_PATCH *down[2];
+    uint32_t        values[2];
+
+    if (!length || prefixdb_patch_empty(base, node, value) || prefixdb_patch_leaf(base, node, value))
+    {
+        return 0;
+    }
+    prefixdb_patch_children(base, node, value, length, down, values);
+    return prefixdb_patch_empty(base, down[0], values[0]) != prefixdb_patch_empty(base, down[1], values[1]);
+}
+
+static void prefixdb_patch_release(_PREFIXDB_PATCH *node)
+{
+    if (node)
+    {
+        prefixdb_patch_release(node->down[0]);
+        prefixdb_patch_release(node->down[1]);
+        free(node);
+    }
+}
+
+// remove a base image leaf from the patched tree (dropping the branches left empty), or add a leaf to an empty branch of it
+// (PREFIXDB_ERROR_ACCESS if the delta does not apply)
+static int prefixdb_patch_edit(_PREFIXDB_PATCH *root, _PREFIXDB *base, uint32_t prefix, uint8_t length, uint64_t tags, int add)
+{
+    _PREFIXDB_PATCH *path[32], *node = root, *child, *down[2];
+    uint8_t         depth, bit;
+
+    for (depth = 0; depth < length - 1; depth ++)
+    {
+        path[depth] = node;
+        bit         = (prefix >> (31 - depth)) & 1;
+        if (!(child = node->down[bit]))
+        {
+            if ((!add && prefixdb_patch_empty(base, NULL, node->values[bit])) || prefixdb_patch_leaf(base, NULL, node->values[bit]))
+            {
+                return PREFIXDB_ERROR_ACCESS;
+            }
+            if (!(child = (_PREFIXDB_PATCH *)calloc(1, sizeof(_PREFIXDB_PATCH))))
+            {
+                return PREFIXDB_ERROR_MEMORY;
+            }
+            prefixdb_patch_children(base, NULL, node->values[bit], depth + 1, down, child->values);
+            node->down[bit] = child;
+        }
+        else if (child->tags)
+        {
+            return PREFIXDB_ERROR_ACCESS;
+        }
+        node = child;
+    }
+    path[depth] = node;
+    bit         = (prefix >> (32 - length)) & 1;
+    if (add)
+    {
+        if (node->down[bit] || !prefixdb_patch_empty(base, NULL, node->values[bit]))
+        {
+            return PREFIXDB_ERROR_ACCESS;
+        }
+        if (!(child = (_PREFIXDB_PATCH *)calloc(1, sizeof(_PREFIXDB_PATCH))))
+        {
+            return PREFIXDB_ERROR_MEMORY;
+        }
+        child->tags      = tags;
+        child->values[0] = child->values[1] = base->nodes_count;
+        node->down[bit]  = child;
+        return PREFIXDB_ERROR_OK;
+    }
+    if (node->down[bit] || !prefixdb_patch_leaf(base, NULL, node->values[bit]) || prefixdb_value_tags(base, node->values[bit]) != tags)
+    {
+        return PREFIXDB_ERROR_ACCESS;
+    }
+    node->values[bit] = base->nodes_count;
+    while (depth && !node->down[0] && !node->down[1] && node->values[0] == base->nodes_count && node->values[1] == base->nodes_count)
+    {
+        depth --;
+        bit                      = (prefix >> (31 - depth)) & 1;
+        path[depth]->down[bit]   = NULL;
+        path[depth]->values[bit] = base->nodes_count;
+        free(node);
+        node = path[depth];
+    }
+    return PREFIXDB_ERROR_OK;
+}
+
+// number (first pass, collecting the leaves lists) then write (second pass) the patched tree the way prefixdb_serialize_into()
+// writes the same leaves: nodes ids in depth-first order, chains of single-child nodes collapsed into skip entries
+static uint32_t prefixdb_patch_visit(_PREFIXDB_PATCHING *patching, _PREFIXDB_PATCH *node, uint32_t value, uint32_t prefix, uint8_t length, int up_single)
+{
+    _PREFIXDB       *base = patching->base, *image = &(patching->image);
+    _PREFIXDB_PATCH *down[2];
+    uint32_t        values[2], id, index;
+    uint8_t         only, *entry, count;
+    int             single;
+
+    if (prefixdb_patch_empty(base, node, value))
+    {
+        return image->nodes_count;
+    }
+    if (prefixdb_patch_leaf(base, node, value))
+    {
+        if (patching->write)
+        {
+            return prefixdb_leaf_value(image, node ? node->tags : prefixdb_value_tags(base, value));
+        }
+        index = value - base->nodes_count - 16;
+        if (node)
+        {
+            patching->tags[patching->tags_count ++] = node->tags;
+        }
+        else if (base->values && index < base->values_count)
+        {
+            patching->used[index] = 1;
+        }
+        else
+        {
+            patching->plain = 1;
+        }
+        return 0;
+    }
+    prefixdb_patch_children(base, node, value, length, down, values);
+    single = length && prefixdb_patch_empty(base, down[0], values[0]) != prefixdb_patch_empty(base, down[1], values[1]);
+    only   = prefixdb_patch_empty(base, down[0], values[0]) ? 1 : 0;
+    if (!single || (!up_single && !prefixdb_patch_single(base, down[only], values[only], length + 1)))
+    {
+        id        = patching->nodes ++;
+        values[0] = prefixdb_patch_visit(patching, down[0], values[0], prefix, length + 1, single);
+        values[1] = prefixdb_patch_visit(patching, down[1], values[1], prefix | (0x80000000 >> length), length + 1, single);
+        if (patching->write)
+        {
+            prefixdb_write_node(image, id, values[0], values[1]);
+        }
+        return id;
+    }
+    prefix |= only ? 0x80000000 >> length : 0;
+    if (up_single)
+    {
+        return prefixdb_patch_visit(patching, down[only], values[only], prefix, length + 1, 1);
+    }
+    id    = patching->skips ++;
+    value = prefixdb_patch_visit(patching, down[only], values[only], prefix, length + 1, 1);
+    if (patching->write)
+    {
+        // the skip entry keeps the prefix and length of the record ending the chain
+        for (node = down[only], index = values[only], length ++; prefixdb_patch_single(base, node, index, length); length ++)
+        {
+            prefixdb_patch_children(base, node, index, length, down, values);
+            only    = prefixdb_patch_empty(base, down[0], values[0]) ? 1 : 0;
+            prefix |= only ? 0x80000000 >> length : 0;
+            node    = down[only];
+            index   = values[only];
+        }
+        entry    = image->skips + (id * (image->records_size + 5));
+        entry[0] = prefix >> 24;
+        entry[1] = prefix >> 16;
+        entry[2] = prefix >> 8;
+        entry[3] = prefix;
+        entry[4] = length;
+        for (count = image->records_size; count; count --)
+        {
+            entry[4 + count] = (uint8_t)(value & 0xff);
+            value          >>= 8;
+        }
+    }
+    return prefixdb_skips_base(image) + id;
+}
+
+// the lists of the patched image: those of the base image still referenced, plus the ones of the added leaves
+static int prefixdb_patch_values(_PREFIXDB_PATCHING *patching)
+{
+    _PREFIXDB *base = patching->base, *image = &(patching->image);
+    uint32_t  index;
+
+    if (!(image->values = (uint64_t *)malloc((base->values_count + patching->tags_count + 1) * sizeof(uint64_t))))
+    {
+        return PREFIXDB_ERROR_MEMORY;
+    }
+    for (index = 0; index < base->values_count; index ++)
+    {
+        if (patching->used[index])
+        {
+            image->values[image->values_count ++] = base->values[index];
+        }
+    }
+    for (index = 0; index < patching->tags_count; index ++)
+    {
+        image->values[image->values_count ++] = patching->tags[index];
+    }
+    if (patching->plain)
+    {
+        image->values[image->values_count ++] = 1;
+    }
+    prefixdb_values_sort(image);
+    return PREFIXDB_ERROR_OK;
+}
+
+// write into image the image of base with the removed then added delta entries applied: the changed leaves are applied to a
+// tree materializing only their paths, any other subtree being re-encoded straight from the base image records (nodes ids
+// shift, so the whole image is still written once, but no build trie is rebuilt nor serialized), yielding the very same image
+// as a whole serialization of the resulting prefixes (the image is released on error)
+static int prefixdb_patch_image(_PREFIXDB *base, const uint8_t *delta, uint32_t removed, uint32_t added, _PREFIXDB *image)
+{
+    _PREFIXDB_PATCHING patching;
+    _PREFIXDB_PATCH    root;
+    const uint8_t      *entry;
+    uint32_t           index;
+    int                status = PREFIXDB_ERROR_OK;
+
+    memset(&patching, 0, sizeof(patching));
+    memset(&root, 0, sizeof(root));
+    patching.base  = base;
+    root.values[0] = root.values[1] = base->nodes_count;
+    if (base->nodes_count)
+    {
+        prefixdb_patch_children(base, NULL, 0, 0, root.down, root.values);
+    }
+    for (index = 0, entry = delta + PREFIXDB_DELTA_HEADER; index < removed + added && status == PREFIXDB_ERROR_OK; index ++, entry += PREFIXDB_DELTA_ENTRY)
+    {
+        status = prefixdb_patch_edit(&root, base, prefixdb_get_field(entry, 4), entry[4], prefixdb_get_field(entry + 5, 8), index >= removed);
+    }
+    if (status == PREFIXDB_ERROR_OK && (!(patching.used = (uint8_t *)calloc(base->values_count + 1, 1)) ||
+        !(patching.tags = (uint64_t *)malloc(((uint64_t)added + 1) * sizeof(uint64_t)))))
+    {
+        status = PREFIXDB_ERROR_MEMORY;
+    }
+    if (status == PREFIXDB_ERROR_OK)
+    {
+        if (root.down[0] || root.down[1] || root.values[0] != base->nodes_count || root.values[1] != base->nodes_count)
+        {
+            prefixdb_patch_visit(&patching, &root, 0, 0, 0, 0);
+        }
+        patching.image.nodes_count = patching.nodes;
+        patching.image.skips_count = patching.skips;
+        patching.image.engine      = delta[6] <= PREFIXDB_ENGINE_INTERVALS ? delta[6] : PREFIXDB_ENGINE_TRIE;
+        if ((status = prefixdb_patch_values(&patching)) == PREFIXDB_ERROR_OK &&
+            (status = prefixdb_layout(&(patching.image), -1)) == PREFIXDB_ERROR_OK)
+        {
+            patching.nodes = patching.skips = 0;
+            patching.write = 1;
+            if (patching.image.nodes_count)
+            {
+                prefixdb_patch_visit(&patching, &root, 0, 0, 0, 0);
+            }
+            status = prefixdb_seal(&(patching.image));
+        }
+    }
+    prefixdb_patch_release(root.down[0]);
+    prefixdb_patch_release(root.down[1]);
+    free(patching.used);
+    free(patching.tags);
+    if (status != PREFIXDB_ERROR_OK)
+    {
+        prefixdb_engine_release(&(patching.image));
+        free(patching.image.data);
+        free(patching.image.values);
+        return status;
+    }
+    memcpy(image, &(patching.image), sizeof(_PREFIXDB));
+    return PREFIXDB_ERROR_OK;
+}
+
+// delta between the images of two databases: a 32-bytes header (marker, version, resulting engine, removed and added leaves
+// counts, checksums of the base image and of the image patching it yields) followed by the removed then added leaves (prefix,
+// length and lists mask), so that a typical update ships a few entries instead of a whole image (the returned buffer is
+// released with free()); the resulting image is written once to get its checksum, as targets saved in another layout (v1
+// images for instance) have the same prefixes but not the same bytes
+int prefixdb_diff(PREFIXDB *_base, PREFIXDB *_target, uint8_t **delta, uint32_t *size)
+{
+    _PREFIXDB        *base = (_PREFIXDB *)_base, *target = (_PREFIXDB *)_target, image;
+    _PREFIXDB_LEAVES removed, added;
+    uint64_t         allocated;
+    uint32_t         removals, count;
+    int              status;
+
+    if (!base || !target || !delta || !size)
+    {
+        return PREFIXDB_ERROR_PARAM;
+    }
+    if ((status = prefixdb_leaves(base, &removed)) != PREFIXDB_ERROR_OK)
+    {
+        return status;
+    }
+    if ((status = prefixdb_leaves(target, &added)) != PREFIXDB_ERROR_OK)
+    {
+        free(removed.leaves);
+        return status;
+    }
+    allocated = PREFIXDB_DELTA_HEADER + ((uint64_t)removed.count + added.count) * PREFIXDB_DELTA_ENTRY;
+    if (allocated > 0xffffffff || !(*delta = (uint8_t *)malloc(allocated)))
+    {
+        free(removed.leaves);
+        free(added.leaves);
+        return PREFIXDB_ERROR_MEMORY;
+    }
+    memset(*delta, 0, PREFIXDB_DELTA_HEADER);
+    removals = prefixdb_leaves_missing(&removed, &added, *delta + PREFIXDB_DELTA_HEADER);
+    count    = prefixdb_leaves_missing(&added, &removed, *delta + PREFIXDB_DELTA_HEADER + (removals * PREFIXDB_DELTA_ENTRY));
+    prefixdb_put_field(*delta, PREFIXDB_DELTA_MARKER, 4);
+    prefixdb_put_field(*delta + 4, PREFIXDB_DELTA_VERSION, 2);
+    (*delta)[6] = target->engine;
+    prefixdb_put_field(*delta + 8, removals, 4);
+    prefixdb_put_field(*delta + 12, count, 4);
+    prefixdb_put_field(*delta + 16, prefixdb_image_checksum(base), 8);
+    *size = PREFIXDB_DELTA_HEADER + (removals + count) * PREFIXDB_DELTA_ENTRY;
+    free(removed.leaves);
+    free(added.leaves);
+
+    // the resulting image is the one patching writes (in the current layout), whatever the layout of the target image
+    if ((status = prefixdb_patch_image(base, *delta, removals, count, &image)) != PREFIXDB_ERROR_OK)
+    {
+        free(*delta);
+        *delta = NULL;
+        return status;
+    }
+    prefixdb_put_field(*delta + 24, prefixdb_image_checksum(&image), 8);
+    prefixdb_engine_release(&image);
+    free(image.data);
+    free(image.values);
+    return PREFIXDB_ERROR_OK;
+}
+
+// apply a delta to the database it was computed from (PREFIXDB_ERROR_ACCESS if its image does not match the delta base, and
+// PREFIXDB_ERROR_CHECKSUM if the patched image does not match the delta result): the patched image replaces the base one only
+// once checked, leaving the database untouched on any error, and frozen otherwise (adding prefixes later rebuilds its build
+// trie from the image)
+int prefixdb_patch(PREFIXDB *_db, const uint8_t *delta, uint32_t size)
+{
+    _PREFIXDB     *db = (_PREFIXDB *)_db, image;
+    const uint8_t *entry;
+    uint32_t      removed, added, index;
+    int           status;
+
+    if (!db || !delta || size < PREFIXDB_DELTA_HEADER || prefixdb_get_field(delta, 4) != PREFIXDB_DELTA_MARKER ||
+        prefixdb_get_field(delta + 4, 2) != PREFIXDB_DELTA_VERSION)
+    {
+        return PREFIXDB_ERROR_PARAM;
+    }
+    removed = prefixdb_get_field(delta + 8, 4);
+    added   = prefixdb_get_field(delta + 12, 4);
+    if (PREFIXDB_DELTA_HEADER + ((uint64_t)removed + added) * PREFIXDB_DELTA_ENTRY != size)
+    {
+        return PREFIXDB_ERROR_PARAM;
+    }
+    for (index = 0, entry = delta + PREFIXDB_DELTA_HEADER; index < removed + added; index ++, entry += PREFIXDB_DELTA_ENTRY)
+    {
+        if (!entry[4] || entry[4] > 32 || !prefixdb_get_field(entry + 5, 8))
+        {
+            return PREFIXDB_ERROR_PARAM;
+        }
+    }
+    if (prefixdb_serialize(db) != PREFIXDB_ERROR_OK)
+    {
+        return PREFIXDB_ERROR_PARAM;
+    }
+    if (prefixdb_image_checksum(db) != prefixdb_get_field(delta + 16, 8))
+    {
+        return PREFIXDB_ERROR_ACCESS;
+    }
+    if ((status = prefixdb_patch_image(db, delta, removed, added, &image)) != PREFIXDB_ERROR_OK)
+    {
+        return status;
+    }
+    if (prefixdb_image_checksum(&image) != prefixdb_get_field(delta + 24, 8))
+    {
+        prefixdb_engine_release(&image);
+        free(image.data);
+        free(image.values);
+        return PREFIXDB_ERROR_CHECKSUM;
+    }
+
+    if (db->flags & PREFIXDB_FLAGS_COPY)
+    {
+        free(db->data);
+    }
+    else if (db->flags & PREFIXDB_FLAGS_MMAP)
+    {
+        munmap(db->data, db->data_size);
+        close(db->handle);
+    }
+    free(db->values);
+    free(db->prefilter);
+    free(db->counters);
+    db->prefilter = NULL;
+    db->counters  = NULL;
+    prefixdb_engine_release(db);
+    prefixdb_chunks_release(db);
+    db->data         = image.data;
+    db->records      = image.records;
+    db->skips        = image.skips;
+    db->index        = image.index;
+    db->summary      = image.summary;
+    db->checksum     = image.checksum;
+    db->lookup       = image.lookup;
+    db->lookup_size  = image.lookup_size;
+    db->hash         = image.hash;
+    db->intervals    = image.intervals;
+    db->data_size    = image.data_size;
+    db->records_size = image.records_size;
+    db->nodes_count  = image.nodes_count;
+    db->skips_count  = image.skips_count;
+    db->values       = image.values;
+    db->values_count = image.values_count;
+    db->version      = image.version;
+    db->engine       = image.engine;
+    db->generation   = image.generation;
+    db->flags        = (db->flags & ~PREFIXDB_FLAGS_MMAP) | PREFIXDB_FLAGS_COPY | PREFIXDB_FLAGS_SERIALIZED | PREFIXDB_FLAGS_FREEZE;
+    return prefixdb_options(db);
+}
+
+// strict dotted-quad parser, returning the number of characters consumed (0 if no valid address starts the input)
+int prefixdb_parse_address(const char *input, uint32_t size, uint32_t *address)
 {
-    _PREFIXDB *db;
+    uint32_t value = 0, octet, digits, position = 0, part;
 
-    if (!_db || !(db = (_PREFIXDB *)*_db))
+    if (!input || !address)
     {
-        return PREFIXDB_ERROR_PARAM;
+        return 0;
     }
-    prefixdb_free_down(&(db->nodes));
-    if (db->data)
+    for (part = 0; part < 4; part ++)
     {
-        if (db->flags & PREFIXDB_FLAGS_COPY)
+        if (part)
         {
-            free(db->data);
+            if (position >= size || input[position] != '.')
+            {
+                return 0;
+            }
+            position ++;
         }
-        else if (db->flags & PREFIXDB_FLAGS_MMAP)
+        for (octet = 0, digits = 0; position < size && digits < 3 && input[position] >= '0' && input[position] <= '9'; position ++, digits ++)
         {
-            munmap(db->data, db->data_size);
-            close(db->handle);
+            octet = (octet * 10) + (input[position] - '0');
+        }
+        if (!digits || octet > 255)
+        {
+            return 0;
         }
+        value = (value << 8) | octet;
     }
-    free(*_db);
-    return PREFIXDB_ERROR_OK;
+    if (position < size && ((input[position] >= '0' && input[position] <= '9') || input[position] == '.'))
+    {
+        return 0;
+    }
+    *address = value;
+    return position;
 }
 
-int prefixdb_add_binary(PREFIXDB *_db, uint32_t address, uint8_t length, const PREFIXDBINFO *__info)
+int prefixdb_parse_prefix(const char *input, uint32_t size, uint32_t *address, uint8_t *length)
 {
-    _PREFIXDB_NODE *pnode, *anode;
-    _PREFIXDB      *db = (_PREFIXDB *)_db;
-    int8_t         bit, type = 0, allocated = 0;
+    uint32_t value = 0, digits = 0;
+    int      position;
 
-    if (!db || length <= 0 || length > 32)
+    if (!length || !(position = prefixdb_parse_address(input, size, address)))
     {
-        return PREFIXDB_ERROR_PARAM;
+        return 0;
     }
-    db->flags &= ~PREFIXDB_FLAGS_SERIALIZED;
-    pnode = &(db->nodes);
-    for (bit = 31; bit > 31 - length; bit --)
+    *length = 32;
+    if (position < size && input[position] == '/')
     {
-        type = (address & (1 << bit)) ? 1 : 0;
-        if (!(pnode->down[type]))
+        for (position ++; position < size && digits < 2 && input[position] >= '0' && input[position] <= '9'; position ++, digits ++)
         {
-            if (!(pnode->down[type] = anode = (_PREFIXDB_NODE *)calloc(1, sizeof(_PREFIXDB_NODE))))
-            {
-                return PREFIXDB_ERROR_MEMORY;
-            }
-            anode->up = pnode;
-            allocated = 1;
+            value = (value * 10) + (input[position] - '0');
         }
-        pnode = pnode->down[type];
-        if (!allocated && !(pnode->down[0]) && !(pnode->down[1])) // longer prefix redux
+        if (!digits || !value || value > 32 || (position < size && input[position] >= '0' && input[position] <= '9'))
         {
-            break;
+            return 0;
         }
-        allocated = 0;
+        *length = value;
     }
-    prefixdb_free_down(pnode); // shorter prefix redux
+    return position;
+}
+
+int prefixdb_free_info(PREFIXDBINFO **_info)
+{
     return PREFIXDB_ERROR_OK;
 }
 
-int prefixdb_add_string(PREFIXDB *_db, const char *prefix, const void *__info)
+int prefixdb_verify(PREFIXDB *_db)
 {
-    struct in_addr address;
-    uint8_t        length = 32;
-    char           line[64], *token;
+    _PREFIXDB *db = (_PREFIXDB *)_db;
+    uint64_t  checksum;
 
-    if (!prefix)
+    if (!db || prefixdb_serialize(db) != PREFIXDB_ERROR_OK)
     {
         return PREFIXDB_ERROR_PARAM;
     }
-    memset(line, 0, sizeof(line));
-    snprintf(line, sizeof(line), "%s", prefix);
-    if ((token = strchr(line, '/')))
-    {
-        *token = 0;
-        length = atoi(token + 1);
-    }
-    if (!inet_aton(line, &address))
+    if (!db->checksum)
     {
-        return PREFIXDB_ERROR_PARAM;
+        return PREFIXDB_ERROR_NOTFOUND;
     }
-    return prefixdb_add_binary(_db, htonl(address.s_addr), length, __info);
+    checksum = ((uint64_t)ntohl(*(uint32_t *)(db->checksum)) << 32) | ntohl(*(uint32_t *)(db->checksum + 4));
+    return prefixdb_checksum(db->data, db->checksum - db->data) == checksum ? PREFIXDB_ERROR_OK : PREFIXDB_ERROR_ACCESS;
 }
 
-int prefixdb_add_file(PREFIXDB *_db, const char *path)
+static uint32_t prefixdb_count_down(_PREFIXDB_NODE *node)
+{
+    return (node->down[0] ? 1 + prefixdb_count_down(node->down[0]) : 0) + (node->down[1] ? 1 + prefixdb_count_down(node->down[1]) : 0);
+}
+
+// statistics stay cheap (nothing proportional to the image size), the checksum is only reported present: prefixdb_verify()
+// checks it
+int prefixdb_stats(PREFIXDB *_db, PREFIXDBSTATS *stats)
 {
-    FILE *input;
-    int  status;
-    char line[64], *token;
+    _PREFIXDB *db = (_PREFIXDB *)_db;
+    uint32_t  count;
 
-    if (!path || !(input = fopen(path, "r")))
+    if (!db || !stats || prefixdb_serialize(db) != PREFIXDB_ERROR_OK)
     {
         return PREFIXDB_ERROR_PARAM;
     }
-    while (fgets(line, sizeof(line) - 1, input))
+    memset(stats, 0, sizeof(PREFIXDBSTATS));
+    stats->nodes        = db->nodes_count;
+    stats->values       = db->values_count;
+    stats->skips        = db->skips_count;
+    stats->records_size = db->records_size;
+    stats->data_size    = db->data_size;
+    stats->trie_nodes   = prefixdb_count_down(&(db->nodes));
+    stats->trie_size    = (uint64_t)db->chunks_count * sizeof(_PREFIXDB_CHUNK);
+    stats->version      = db->version;
+    stats->checksummed  = db->checksum ? 1 : 0;
+    if (db->summary)
     {
-        if ((token = strpbrk(line, "#\r\n")))
-        {
-            *token = 0;
-        }
-        if (*line)
+        stats->leaves        = ntohl(*(uint32_t *)(db->summary));
+        stats->depth_max     = ntohl(*(uint32_t *)(db->summary + 4));
+        for (count = 0; count <= 32; count ++)
         {
-            if ((status = prefixdb_add_string(_db, line, NULL)) != PREFIXDB_ERROR_OK)
-            {
-                break;
-            }
+            stats->lengths[count] = ntohl(*(uint32_t *)(db->summary + 8 + (count * 4)));
+            stats->depths[count]  = ntohl(*(uint32_t *)(db->summary + 8 + ((33 + count) * 4)));
         }
+        stats->depth_average = (double)(((uint64_t)ntohl(*(uint32_t *)(db->summary + PREFIXDB_SUMMARY_SIZE - 8)) << 32) |
+                                        ntohl(*(uint32_t *)(db->summary + PREFIXDB_SUMMARY_SIZE - 4))) / 1000000;
     }
-    fclose(input);
-    return status;
-}
-
-static int prefixdb_write_node(_PREFIXDB *db, uint32_t node, uint32_t value0, uint32_t value1)
-{
-    uint8_t *base = db->data + (node * 2 * db->records_size), count;
-
-    if (!db || !db->data || node > db->nodes_count || value0 >= db->data_size || value1 >= db->data_size)
+    else if (db->nodes_count)
     {
-        return PREFIXDB_ERROR_PARAM;
+        prefixdb_walk(db, 0, 0, 0, 0, prefixdb_stats_walk, stats);
     }
-    count = db->records_size;
-    while (count)
+    if (db->flags & PREFIXDB_FLAGS_CACHE)
     {
-        *(base + count - 1) = (uint8_t)(value0 & 0xff);
-        value0 >>= 8;
-        count --;
+        stats->cache_size = (1 << PREFIXDB_CACHE_LENGTH) * sizeof(_PREFIXDB_CACHE_ENTRY);
     }
-    count = db->records_size;
-    while (count)
+    if (db->counters)
     {
-        *(base + db->records_size + count - 1) = (uint8_t)(value1 & 0xff);
-        value1 >>= 8;
-        count --;
+        stats->counters_size = (prefixdb_counters_count(db) + 1) * sizeof(uint64_t);
     }
-    return PREFIXDB_ERROR_OK;
-}
-
-static int prefixdb_serialize(_PREFIXDB *db)
-{
-    _PREFIXDB_NODE *pnode;
-    uint32_t       count;
-
-    if (db->flags & PREFIXDB_FLAGS_SERIALIZED)
+    stats->engine = db->engine;
+    if (db->hash)
     {
-        return PREFIXDB_ERROR_OK;
+        stats->engine_size = sizeof(_PREFIXDB_HASH) + ((db->hash->size + 1) * sizeof(_PREFIXDB_SLOT));
     }
-    db->pass += 5;
-
-    // prefixes redux (pass 1)
-    pnode = &(db->nodes);
-    while (1)
+    if (db->intervals)
     {
-        if (pnode->down[0] && !pnode->down[0]->down[0] && !pnode->down[0]->down[1] &&
-            pnode->down[1] && !pnode->down[1]->down[0] && !pnode->down[1]->down[1])
-        {
-            free(pnode->down[0]);
-            free(pnode->down[1]);
-            pnode->down[0] = pnode->down[1] = NULL;
-        }
-        while (pnode->down[0] && pnode->explored[0] != (db->pass + 1))
-        {
-            pnode->explored[0] = (db->pass + 1);
-            pnode              = pnode->down[0];
-        }
-        if (pnode->down[1] && pnode->explored[1] != (db->pass + 1))
-        {
-            pnode->explored[1] = (db->pass + 1);
-            pnode              = pnode->down[1];
-            continue;
-        }
-        if (pnode == &(db->nodes))
-        {
-            break;
-        }
-        pnode = pnode->up;
+        stats->engine_size = sizeof(_PREFIXDB_INTERVALS) + (db->intervals->size * 2 * sizeof(uint32_t));
     }
-
-    // nodes numbering (pass 2)
-    pnode = &(db->nodes);
-    db->nodes_count = 0;
-    while (1)
+    if (db->prefilter)
     {
-        if (pnode->flaggued != (db->pass + 1))
-        {
-            pnode->flaggued = (db->pass + 1);
-            pnode->id       = 0;
-            if (pnode->down[0] || pnode->down[1])
-            {
-                pnode->id = db->nodes_count ++;
-            }
-        }
-        while (pnode->down[0] && pnode->explored[0] != (db->pass + 2))
-        {
-            pnode->explored[0] = (db->pass + 2);
-            pnode              = pnode->down[0];
-            if (pnode->flaggued != (db->pass + 1))
-            {
-                pnode->flaggued = (db->pass + 1);
-                pnode->id       = 0;
-                if (pnode->down[0] || pnode->down[1])
-                {
-                    pnode->id = db->nodes_count ++;
-                }
-            }
-        }
-        if (pnode->down[1] && pnode->explored[1] != (db->pass + 2))
-        {
-            pnode->explored[1] = (db->pass + 2);
-            pnode              = pnode->down[1];
-            continue;
-        }
-        if (pnode == &(db->nodes))
+        stats->prefilter_size = (1 << PREFIXDB_PREFILTER_LENGTH) / 8;
+        for (count = 0; count < stats->prefilter_size; count ++)
         {
-            break;
+            stats->prefilter_coverage += __builtin_popcount(db->prefilter[count]);
         }
-        pnode = pnode->up;
     }
-
-    if (db->data)
+    stats->memory = sizeof(_PREFIXDB) + db->data_size + stats->trie_size + stats->prefilter_size + stats->counters_size + stats->engine_size +
+                    (db->values_count * sizeof(uint64_t)) + (db->shards ? PREFIXDB_SHARDS * sizeof(_PREFIXDB_SHARD) : 0);
+    if (db->shards)
     {
-        if (db->flags & PREFIXDB_FLAGS_COPY)
-        {
-            free(db->data);
-        }
-        else if (db->flags & PREFIXDB_FLAGS_MMAP)
+        for (count = 0; count < PREFIXDB_SHARDS; count ++)
         {
-            munmap(db->data, db->data_size);
-            close(db->handle);
+            stats->prefilter_checked  += db->shards[count].prefilter_checked;
+            stats->prefilter_rejected += db->shards[count].prefilter_rejected;
+            stats->cache_hits         += db->shards[count].cache_hits;
+            stats->cache_misses       += db->shards[count].cache_misses;
         }
     }
+    return PREFIXDB_ERROR_OK;
+}
 
-    db->records_size = 0;
-    count            = db->nodes_count + 16;
-    do
-    {
-        db->records_size ++;
-    } while (count /= 256);
-    db->data_size = ((2 * db->records_size) * db->nodes_count) + 31;
-    if (!(db->data = (uint8_t *)calloc(1, db->data_size)))
+static void prefixdb_histogram_merge(PREFIXDBHISTOGRAM *histogram, const PREFIXDBHISTOGRAM *source)
+{
+    uint32_t bucket;
+
+    histogram->count += __atomic_load_n(&(source->count), __ATOMIC_RELAXED);
+    histogram->total += __atomic_load_n(&(source->total), __ATOMIC_RELAXED);
+    for (bucket = 0; bucket < PREFIXDB_HISTOGRAM_SIZE; bucket ++)
     {
-        return PREFIXDB_ERROR_MEMORY;
+        histogram->buckets[bucket] += __atomic_load_n(&(source->buckets[bucket]), __ATOMIC_RELAXED);
     }
-    db->flags |= (PREFIXDB_FLAGS_COPY | PREFIXDB_FLAGS_SERIALIZED);
-    *((uint32_t *)(db->data + db->data_size - 4))  = htonl(PREFIXDB_MAGIC_MARKER);
-    *((uint32_t *)(db->data + db->data_size - 8))  = htonl(db->data_size);
-    *((uint16_t *)(db->data + db->data_size - 10)) = htons(PREFIXDB_LIBRARY_VERSION);
-    *((uint32_t *)(db->data + db->data_size - 14)) = htonl(db->nodes_count);
-    *((uint8_t  *)(db->data + db->data_size - 15)) = (uint8_t)(db->records_size * 8);
+}
 
-    // nodes writing (pass 3)
-    pnode = &(db->nodes);
-    while (1)
+int prefixdb_metrics_merge(PREFIXDBMETRICS *metrics, const PREFIXDBMETRICS *source)
+{
+    if (!metrics || !source)
     {
-        if (pnode->flaggued != (db->pass + 2) && (pnode->id || pnode == &(db->nodes)))
-        {
-            pnode->flaggued = (db->pass + 2);
-            prefixdb_write_node
-            (
-                db, pnode->id,
-                pnode->down[0] ? (pnode->down[0]->id ? pnode->down[0]->id : db->nodes_count + 16) : db->nodes_count,
-                pnode->down[1] ? (pnode->down[1]->id ? pnode->down[1]->id : db->nodes_count + 16) : db->nodes_count
-            );
-        }
-        while (pnode->down[0] && pnode->explored[0] != (db->pass + 3))
-        {
-            pnode->explored[0] = (db->pass + 3);
-            pnode              = pnode->down[0];
-            if (pnode->flaggued != (db->pass + 2) && pnode->id)
-            {
-                pnode->flaggued = (db->pass + 2);
-                prefixdb_write_node
-                (
-                    db, pnode->id,
-                    pnode->down[0] ? (pnode->down[0]->id ? pnode->down[0]->id : db->nodes_count + 16) : db->nodes_count,
-                    pnode->down[1] ? (pnode->down[1]->id ? pnode->down[1]->id : db->nodes_count + 16) : db->nodes_count
-                );
-            }
-        }
-        if (pnode->down[1] && pnode->explored[1] != (db->pass + 3))
-        {
-            pnode->explored[1] = (db->pass + 3);
-            pnode              = pnode->down[1];
-            continue;
-        }
-        if (pnode == &(db->nodes))
-        {
-            break;
-        }
-        pnode = pnode->up;
+        return PREFIXDB_ERROR_PARAM;
     }
-
+    if (source->timestamp > metrics->timestamp)
+    {
+        metrics->timestamp = source->timestamp;
+    }
+    metrics->matches += __atomic_load_n(&(source->matches), __ATOMIC_RELAXED);
+    metrics->depths  += __atomic_load_n(&(source->depths), __ATOMIC_RELAXED);
+    prefixdb_histogram_merge(&(metrics->searches), &(source->searches));
+    prefixdb_histogram_merge(&(metrics->loads), &(source->loads));
+    prefixdb_histogram_merge(&(metrics->serializations), &(source->serializations));
     return PREFIXDB_ERROR_OK;
 }
 
-int prefixdb_save_binary(PREFIXDB *_db, uint8_t **data, uint32_t *size, uint8_t flags)
+int prefixdb_metrics(PREFIXDB *_db, PREFIXDBMETRICS *metrics)
 {
     _PREFIXDB *db = (_PREFIXDB *)_db;
+    uint32_t  shard;
 
-    if (!db || prefixdb_serialize(db) != PREFIXDB_ERROR_OK)
+    if (!db || !metrics)
     {
         return PREFIXDB_ERROR_PARAM;
     }
-    if (data)
+    memset(metrics, 0, sizeof(PREFIXDBMETRICS));
+    for (shard = 0; db->metrics && shard < PREFIXDB_SHARDS; shard ++)
     {
-        if (flags & PREFIXDB_FLAGS_COPY)
-        {
-            if (!(*data = (uint8_t *)malloc(db->data_size)))
-            {
-                return PREFIXDB_ERROR_MEMORY;
-            }
-            memcpy(*data, db->data, db->data_size);
-        }
-        else
-        {
-            *data = db->data;
-        }
+        prefixdb_metrics_merge(metrics, &(db->metrics[shard].metrics));
     }
-    if (size) *size = db->data_size;
+    metrics->timestamp = prefixdb_clock();
     return PREFIXDB_ERROR_OK;
 }
 
-int prefixdb_save_file(PREFIXDB *_db, const char *path)
+uint64_t prefixdb_metrics_percentile(const PREFIXDBHISTOGRAM *histogram, double percentile)
 {
-    FILE     *handle;
-    uint32_t size;
-    uint8_t  *data;
-    int      status;
+    uint64_t target, count = 0;
+    uint32_t bucket, exponent;
 
-    if (!path)
+    if (!histogram || !histogram->count)
     {
-        return PREFIXDB_ERROR_PARAM;
+        return 0;
     }
-    if ((status = prefixdb_save_binary(_db, &data, &size, 0)))
+    target = (uint64_t)((double)histogram->count * percentile / 100);
+    for (bucket = 0; bucket < PREFIXDB_HISTOGRAM_SIZE - 1; bucket ++)
     {
-        return status;
+        if ((count += histogram->buckets[bucket]) > target)
+        {
+            break;
+        }
     }
-    if (!(handle = fopen(path, "w")))
+    if (bucket < 8)
     {
-        return PREFIXDB_ERROR_ACCESS;
+        return bucket;
+    }
+    exponent = ((bucket - 8) / 4) + 3;
+    return ((uint64_t)(4 + ((bucket - 8) % 4)) << (exponent - 2)) + ((uint64_t)1 << (exponent - 3));
+}
+
+// client side of the "prefixdb serve" protocol: a request is a 4-bytes header (version, type, big-endian addresses count)
+// followed by the big-endian addresses, the response a 4-bytes header (version, status, count) followed by a matches bitmap
+typedef struct
+{
+    int     handle;
+    uint8_t buffer[4 + (PREFIXDB_PROTOCOL_BATCH * 4)];
+} _PREFIXDB_CLIENT;
+
+PREFIXDBCLIENT *prefixdb_client_open(const char *path)
+{
+    _PREFIXDB_CLIENT   *client;
+    struct sockaddr_un address;
+
+    if (!path || strlen(path) >= sizeof(address.sun_path) || !(client = (_PREFIXDB_CLIENT *)malloc(sizeof(_PREFIXDB_CLIENT))))
+    {
+        return NULL;
     }
-    if (fwrite(data, 1, size, handle) != size)
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    if ((client->handle = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 || connect(client->handle, (struct sockaddr *)&address, sizeof(address)) < 0)
     {
-        fclose(handle);
-        return PREFIXDB_ERROR_ACCESS;
+        if (client->handle >= 0) close(client->handle);
+        free(client);
+        return NULL;
+    }
+    return client;
+}
+
+static int prefixdb_client_transfer(int handle, uint8_t *buffer, uint32_t size, int sending)
+{
+    ssize_t bytes;
+
+    while (size)
+    {
+        if ((bytes = sending ? send(handle, buffer, size, MSG_NOSIGNAL) : recv(handle, buffer, size, 0)) <= 0)
+        {
+            return PREFIXDB_ERROR_ACCESS;
+        }
+        buffer += bytes;
+        size   -= bytes;
     }
-    fclose(handle);
     return PREFIXDB_ERROR_OK;
 }
 
-int prefixdb_search_binary(PREFIXDB *_db, uint32_t address, PREFIXDBINFO **_info)
+int prefixdb_client_search(PREFIXDBCLIENT *_client, const uint32_t *addresses, uint32_t count, uint8_t *results)
 {
-    _PREFIXDB *db = (_PREFIXDB *)_db;
-    uint32_t  next;
-    uint8_t   bit = 31, records_size, *pnode, *precord, count;
+    _PREFIXDB_CLIENT *client = (_PREFIXDB_CLIENT *)_client;
+    uint32_t         batch, index;
+    int              status;
 
-    if (!db || prefixdb_serialize(db) != PREFIXDB_ERROR_OK)
+    if (!client || (count && (!addresses || !results)))
     {
         return PREFIXDB_ERROR_PARAM;
     }
-    records_size = db->records_size;
-    pnode        = db->data;
     do
     {
-        precord = pnode + ((address & (1 << bit)) ? records_size : 0);
-        next    = 0;
-        for (count = 0; count < records_size; count ++)
+        batch = count > PREFIXDB_PROTOCOL_BATCH ? PREFIXDB_PROTOCOL_BATCH : count;
+        client->buffer[0] = PREFIXDB_PROTOCOL_VERSION;
+        client->buffer[1] = PREFIXDB_PROTOCOL_SEARCH;
+        *(uint16_t *)(client->buffer + 2) = htons(batch);
+        for (index = 0; index < batch; index ++)
         {
-            next += (*(precord + count) << (records_size - count - 1) * 8);
+            *(uint32_t *)(client->buffer + 4 + (index * 4)) = htonl(addresses[index]);
         }
-        if (next == db->nodes_count)
+        if ((status = prefixdb_client_transfer(client->handle, client->buffer, 4 + (batch * 4), 1)) != PREFIXDB_ERROR_OK ||
+            (status = prefixdb_client_transfer(client->handle, client->buffer, 4, 0)) != PREFIXDB_ERROR_OK)
         {
-            return PREFIXDB_ERROR_NOTFOUND;
+            return status;
         }
-        else if (next > db->nodes_count)
+        if (client->buffer[0] != PREFIXDB_PROTOCOL_VERSION || ntohs(*(uint16_t *)(client->buffer + 2)) != batch)
         {
-            return PREFIXDB_ERROR_OK;
+            return PREFIXDB_ERROR_ACCESS;
+        }
+        if (client->buffer[1] != PREFIXDB_ERROR_OK)
+        {
+            return client->buffer[1];
+        }
+        if ((status = prefixdb_client_transfer(client->handle, client->buffer, (batch + 7) / 8, 0)) != PREFIXDB_ERROR_OK)
+        {
+            return status;
+        }
+        for (index = 0; index < batch; index ++)
+        {
+            results[index] = (client->buffer[index / 8] & (1 << (index % 8))) ? PREFIXDB_ERROR_OK : PREFIXDB_ERROR_NOTFOUND;
         }
-        pnode = db->data + (next * (records_size * 2));
-    } while (bit --);
-    return PREFIXDB_ERROR_PARAM;
+        addresses += batch;
+        results   += batch;
+        count     -= batch;
+    } while (count);
+    return PREFIXDB_ERROR_OK;
 }
 
-int prefixdb_search_string(PREFIXDB *_db, const char *_address, PREFIXDBINFO **_info)
+int prefixdb_client_close(PREFIXDBCLIENT **_client)
 {
-    struct in_addr address;
+    _PREFIXDB_CLIENT *client;
 
-    if (!_address || !inet_aton(_address, &address))
+    if (!_client || !(client = (_PREFIXDB_CLIENT *)*_client))
     {
         return PREFIXDB_ERROR_PARAM;
     }
-    return prefixdb_search_binary(_db, htonl(address.s_addr), _info);
-}
-
-int prefixdb_free_info(PREFIXDBINFO **_info)
-{
+    close(client->handle);
+    free(client);
+    *_client = NULL;
     return PREFIXDB_ERROR_OK;
 }
@@ -9,22 +9,101 @@
 #define  PREFIXDB_ERROR_MEMORY    (2)
 #define  PREFIXDB_ERROR_ACCESS    (3)
 #define  PREFIXDB_ERROR_NOTFOUND  (4)
+#define  PREFIXDB_ERROR_CHECKSUM  (5)
 
 #define  PREFIXDB_FLAGS_COPY      (0x01)
 #define  PREFIXDB_FLAGS_MMAP      (0x02)
+#define  PREFIXDB_FLAGS_PREFILTER (0x04)
+#define  PREFIXDB_FLAGS_CACHE     (0x08)
+#define  PREFIXDB_FLAGS_METRICS   (0x10)
+#define  PREFIXDB_FLAGS_COUNTERS  (0x20)
+#define  PREFIXDB_FLAGS_FREEZE    (0x40)
+
+#define  PREFIXDB_ENGINE_TRIE     (0)
+#define  PREFIXDB_ENGINE_HASH     (1)
+#define  PREFIXDB_ENGINE_INTERVALS (2)
+
+#define  PREFIXDB_OVERLAP_COVERED (0x01)
+#define  PREFIXDB_OVERLAP_INSIDE  (0x02)
+
+#define  PREFIXDB_HISTOGRAM_SIZE  (144)
+
+#define  PREFIXDB_PROTOCOL_VERSION (1)
+#define  PREFIXDB_PROTOCOL_SEARCH  (1)
+#define  PREFIXDB_PROTOCOL_BATCH   (65535)
 
 typedef  void PREFIXDB;
 typedef  void PREFIXDBINFO;
+typedef  void PREFIXDBCLIENT;
+
+typedef  int (*PREFIXDBOVERLAP)(uint32_t, uint8_t, uint64_t, void *);
+
+typedef struct
+{
+    uint32_t nodes, leaves, values, skips, records_size, data_size, trie_nodes, depth_max, lengths[33], depths[33];
+    uint32_t prefilter_size, prefilter_coverage, cache_size, counters_size, engine, engine_size, version;
+    uint8_t  checksummed;
+    uint64_t memory, trie_size, prefilter_checked, prefilter_rejected, cache_hits, cache_misses;
+    double   depth_average;
+} PREFIXDBSTATS;
+
+typedef struct
+{
+    uint64_t count, total, buckets[PREFIXDB_HISTOGRAM_SIZE];
+} PREFIXDBHISTOGRAM;
+
+typedef struct
+{
+    uint64_t hits, tags;
+    uint32_t address;
+    uint8_t  length;
+} PREFIXDBHITS;
+
+typedef struct
+{
+    uint64_t          timestamp, matches, depths;
+    PREFIXDBHISTOGRAM searches, loads, serializations;
+} PREFIXDBMETRICS;
 
 PREFIXDB *prefixdb_allocate();
 PREFIXDB *prefixdb_load_file(const char *, uint8_t);
 PREFIXDB *prefixdb_load_binary(const uint8_t *, uint32_t, uint8_t);
 int      prefixdb_free(PREFIXDB **);
+int      prefixdb_set_flags(PREFIXDB *, uint8_t, uint8_t);
+int      prefixdb_set_engine(PREFIXDB *, uint8_t);
 int      prefixdb_add_binary(PREFIXDB *, uint32_t, uint8_t, const PREFIXDBINFO *);
 int      prefixdb_add_string(PREFIXDB *, const char *, const PREFIXDBINFO *);
 int      prefixdb_add_file(PREFIXDB *, const char *);
+int      prefixdb_add_binary_tagged(PREFIXDB *, uint32_t, uint8_t, uint64_t);
+int      prefixdb_add_string_tagged(PREFIXDB *, const char *, uint64_t);
+int      prefixdb_add_file_tagged(PREFIXDB *, const char *, uint64_t);
+int      prefixdb_add_binary_batch(PREFIXDB *, const uint32_t *, const uint8_t *, uint32_t);
+int      prefixdb_add_binary_batch_tagged(PREFIXDB *, const uint32_t *, const uint8_t *, uint32_t, uint64_t);
 int      prefixdb_save_binary(PREFIXDB *, uint8_t **, uint32_t *, uint8_t);
 int      prefixdb_save_file(PREFIXDB *, const char *);
+int      prefixdb_freeze(PREFIXDB *);
+int      prefixdb_thaw(PREFIXDB *);
 int      prefixdb_search_binary(PREFIXDB *, uint32_t, PREFIXDBINFO **);
 int      prefixdb_search_string(PREFIXDB *, const char *, PREFIXDBINFO **);
+int      prefixdb_search_binary_tagged(PREFIXDB *, uint32_t, uint64_t *);
+int      prefixdb_search_string_tagged(PREFIXDB *, const char *, uint64_t *);
+int      prefixdb_search_binary_batch(PREFIXDB *, const uint32_t *, uint32_t, uint8_t *);
+int      prefixdb_overlap_binary(PREFIXDB *, uint32_t, uint8_t, uint8_t *, PREFIXDBOVERLAP, void *);
+int      prefixdb_overlap_string(PREFIXDB *, const char *, uint8_t *, PREFIXDBOVERLAP, void *);
+int      prefixdb_coverage(PREFIXDB *, uint32_t, uint8_t, uint64_t, uint64_t *, uint8_t, uint64_t *);
+int      prefixdb_diff(PREFIXDB *, PREFIXDB *, uint8_t **, uint32_t *);
+int      prefixdb_patch(PREFIXDB *, const uint8_t *, uint32_t);
+int      prefixdb_parse_address(const char *, uint32_t, uint32_t *);
+int      prefixdb_parse_prefix(const char *, uint32_t, uint32_t *, uint8_t *);
 int      prefixdb_free_info(PREFIXDBINFO **);
+int      prefixdb_stats(PREFIXDB *, PREFIXDBSTATS *);
+int      prefixdb_counters_top(PREFIXDB *, PREFIXDBHITS *, uint32_t, uint32_t *);
+int      prefixdb_counters_reset(PREFIXDB *);
+int      prefixdb_verify(PREFIXDB *);
+int      prefixdb_metrics(PREFIXDB *, PREFIXDBMETRICS *);
+int      prefixdb_metrics_merge(PREFIXDBMETRICS *, const PREFIXDBMETRICS *);
+uint64_t prefixdb_metrics_percentile(const PREFIXDBHISTOGRAM *, double);
+
+PREFIXDBCLIENT *prefixdb_client_open(const char *);
+int            prefixdb_client_search(PREFIXDBCLIENT *, const uint32_t *, uint32_t, uint8_t *);
+int            prefixdb_client_close(PREFIXDBCLIENT **);
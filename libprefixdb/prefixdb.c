@@ -5,9 +5,21 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <pthread.h>
 #include <sys/time.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
 #include <libprefixdb.h>
 
+static const char *prefixdb_engines[] = { "trie", "hash", "intervals" };
+
 int prefixdb_help()
 {
     fprintf
@@ -15,9 +27,30 @@ int prefixdb_help()
         stderr,
         "usage: prefixdb <action> [<parameters>]\n\n"
         "help                                      show this help screen\n"
-        "import <list> <database>                  create a PrefixDB database from a text prefixes list\n"
-        "search <database> <address>[ <address>]   search address(es) in a PrefixDB database\n"
-        "bench                                     test and bench the installed PrefixDB library\n"
+        "import <list>[ <list>] <database>         create a PrefixDB database from text prefixes list(s), each list\n"
+        "                                          being tagged with its own bit in the matches lists masks\n"
+        "search <database> <address>[ <address>]   search address(es) in a PrefixDB database (with matched lists if tagged)\n"
+        "overlap <database> <prefix>[ <prefix>]    show the stored prefixes covering or lying inside the given prefix(es)\n"
+        "info <database>                           show the structure and statistics of a PrefixDB database\n"
+        "engine <database> <engine>                select the lookup engine recorded in a PrefixDB database (trie, hash\n"
+        "                                          or intervals)\n"
+        "top <database> [<count>]                  search addresses read from stdin (one per line) and show the most matched\n"
+        "                                          prefixes with their hits count (default: 20)\n"
+        "diff <old> <new>                          write the binary delta between two PrefixDB databases to stdout\n"
+        "patch <database> <delta> [<output>]       apply a delta to a PrefixDB database (in place unless an output is given)\n"
+        "stream [<options>] <database> [<input>]   search addresses read from a file or stdin (one per line)\n"
+        "  -f <field>                              address field in each line (default: 1)\n"
+        "  -s <separators>                         fields separators (default: space and tab)\n"
+        "  -l                                      print whole lines prefixed with the search result\n"
+        "  -m                                      only print matching lines\n"
+        "  -t <threads>                            split input processing across worker threads (default: 1)\n"
+        "serve [-t <threads>] <database> <socket>  serve searches over a UNIX socket, reloading the database when it changes\n"
+        "client [<options>] <socket> [<address>]   search address(es) through a serving daemon, or generate load if none given\n"
+        "  -c <connections>                        concurrent client connections (default: 4)\n"
+        "  -b <batch>                              addresses per request (default: 64)\n"
+        "  -d <seconds>                            load generation duration (default: 10)\n"
+        "bench [zipf]                              test and bench the installed PrefixDB library\n"
+        "                                          (optionally with a zipfian searches distribution)\n"
     );
     return 1;
 }
@@ -27,119 +60,2218 @@ int prefixdb_help()
 #define  SW_ELAPSED      ((double)(end.tv_sec - begin.tv_sec) + ((double)(end.tv_usec - begin.tv_usec) / 1000000))
 #define  PREFIXES_COUNT  (500000)
 #define  SEARCHES_COUNT  (500000)
-int prefixdb_bench()
+#define  HOTSPOTS_COUNT  (65536)
+static int prefixdb_bench_search(PREFIXDB *pfdb, const char *label, unsigned int seed, uint32_t *keys, int *matches)
 {
-    PREFIXDB       *pfdb;
     struct timeval begin, end;
     char           address[30];
-    int            exit = 0, status, matches[3], count;
-
-    SW_START; pfdb = prefixdb_allocate(); SW_END;
-    printf("allocate empty database   %s [%.06fs]\n", pfdb ? "pass" : "fail", SW_ELAPSED);
-    exit |= (!pfdb ? 1 : 0);
+    int            status, count;
 
-    printf("add %6d prefixes       ", PREFIXES_COUNT); fflush(stdout);
-    status = 0; srand(time(NULL) + getpid());
+    printf("%-26.26s", label); fflush(stdout);
+    matches[0] = matches[1] = matches[2] = 0;
+    srand(seed);
     SW_START;
-    for (count = 0; count < PREFIXES_COUNT; count ++)
+    for (count = 0; count < SEARCHES_COUNT; count ++)
     {
-        sprintf(address, "%d.%d.%d.%d/%d", (rand() % 223) + 1, (rand() % 223) + 1, (rand() % 223) + 1, (rand() % 223) + 1, (rand() % 12) + 16);
-        status |= prefixdb_add_string(pfdb, address, NULL);
+        if (keys)
+        {
+            status = prefixdb_search_binary(pfdb, keys[count], NULL);
+        }
+        else
+        {
+            sprintf(address, "%d.%d.%d.%d", (rand() % 253) + 1, (rand() % 253) + 1, (rand() % 253) + 1, (rand() % 253) + 1);
+            status = prefixdb_search_string(pfdb, address, NULL);
+        }
+        if      (status == PREFIXDB_ERROR_OK)       matches[0] ++;
+        else if (status == PREFIXDB_ERROR_NOTFOUND) matches[1] ++;
+        else                                        matches[2] ++;
         if (count && !(count % 25000))
         {
             printf("."); fflush(stdout);
         }
     }
     SW_END;
-    printf("\radd %6d prefixes       %s [%.06fs] [%d prefixes/s]", PREFIXES_COUNT, status ? "fail" : "pass", SW_ELAPSED, (int)((double)PREFIXES_COUNT / SW_ELAPSED));
-    for (count = 0; count < PREFIXES_COUNT / 25000; count ++) printf(" "); printf("\n");
-    exit |= (status ? 1 : 0);
+    printf("\r%-26.26s%s [%.06fs] [%d searches/s - %d matched - %d unmatched]", label,
+           matches[2] ? "fail": "pass", SW_ELAPSED, (int)((double)SEARCHES_COUNT / SW_ELAPSED), matches[0], matches[1]);
+    for (count = 0; count < SEARCHES_COUNT / 25000; count ++) printf(" "); printf("\n");
+    return matches[2] ? 1 : 0;
+}
 
-    SW_START; status = prefixdb_save_file(pfdb, "/tmp/bench.pfdb"); SW_END;
-    printf("save database             %s [%.06fs]\n", status == PREFIXDB_ERROR_OK ? "pass" : "fail", SW_ELAPSED);
-    exit |= (status != PREFIXDB_ERROR_OK ? 1 : 0);
+// searches drawn from a fixed set of hot addresses, with the probability of the n-th address proportional to 1/n
+static uint32_t *prefixdb_bench_zipf()
+{
+    uint32_t *keys, hotspots[HOTSPOTS_COUNT];
+    double   weights[HOTSPOTS_COUNT], total = 0, target;
+    int      count, low, high, middle;
 
-    SW_START; status = prefixdb_free(&pfdb); SW_END;
-    printf("release database          %s [%.06fs]\n", status == PREFIXDB_ERROR_OK ? "pass" : "fail", SW_ELAPSED);
-    exit |= (status != PREFIXDB_ERROR_OK ? 1 : 0);
+    if (!(keys = (uint32_t *)malloc(SEARCHES_COUNT * sizeof(uint32_t))))
+    {
+        return NULL;
+    }
+    for (count = 0; count < HOTSPOTS_COUNT; count ++)
+    {
+        hotspots[count] = (((rand() % 253) + 1) << 24) | (((rand() % 253) + 1) << 16) | (((rand() % 253) + 1) << 8) | ((rand() % 253) + 1);
+        weights[count]  = (total += 1.0 / (count + 1));
+    }
+    for (count = 0; count < SEARCHES_COUNT; count ++)
+    {
+        target = ((double)rand() / RAND_MAX) * total;
+        low    = 0;
+        high   = HOTSPOTS_COUNT - 1;
+        while (low < high)
+        {
+            middle = (low + high) / 2;
+            if (weights[middle] < target) low = middle + 1;
+            else                          high = middle;
+        }
+        keys[count] = hotspots[low];
+    }
+    return keys;
+}
 
-    SW_START; pfdb = prefixdb_load_file("/tmp/bench.pfdb", 0); SW_END;
-    printf("load database             %s [%.06fs]\n", pfdb ? "pass" : "fail", SW_ELAPSED);
-    exit |= (!pfdb ? 1 : 0);
+// check tagged lookups against a brute-force OR of the masks of all the covering prefixes, and that single-list databases
+// built through the tagged API keep the plain layout
+#define  TAGGED_LISTS     (3)
+#define  TAGGED_PREFIXES  (2000)
+#define  TAGGED_SEARCHES  (20000)
+static int prefixdb_bench_tagged()
+{
+    PREFIXDB       *pfdb, *plain, *loaded = NULL;
+    PREFIXDBSTATS  stats;
+    struct timeval begin, end;
+    uint32_t       addresses[TAGGED_LISTS * TAGGED_PREFIXES], address, size1, size2, index, count;
+    uint8_t        lengths[TAGGED_LISTS * TAGGED_PREFIXES], *data1, *data2;
+    uint64_t       expected, tags, ltags;
+    const char     *failed = NULL;
+    int            matched = 0;
 
-    printf("search %6d addresses   ", SEARCHES_COUNT); fflush(stdout);
-    matches[0] = matches[1] = matches[2] = 0;
+    pfdb  = prefixdb_allocate();
+    plain = prefixdb_allocate();
     SW_START;
-    for (count = 0; count < SEARCHES_COUNT; count ++)
+    for (index = 0; index < TAGGED_LISTS * TAGGED_PREFIXES; index ++)
     {
-        sprintf(address, "%d.%d.%d.%d", (rand() % 253) + 1, (rand() % 253) + 1, (rand() % 253) + 1, (rand() % 253) + 1);
-        status = prefixdb_search_string(pfdb, address, NULL);
-        if      (status == PREFIXDB_ERROR_OK)       matches[0] ++;
-        else if (status == PREFIXDB_ERROR_NOTFOUND) matches[1] ++;
-        else                                        matches[2] ++;
-        if (count && !(count % 25000))
+        lengths[index]   = (rand() % 17) + 8;
+        addresses[index] = (((uint32_t)rand() << 16) ^ (uint32_t)rand()) & (0xffffffff << (32 - lengths[index]));
+        if (index >= TAGGED_PREFIXES && !(rand() % 4))
         {
-            printf("."); fflush(stdout);
+            addresses[index] = addresses[rand() % TAGGED_PREFIXES];
+        }
+        if (!failed && prefixdb_add_binary_tagged(pfdb, addresses[index], lengths[index], (uint64_t)1 << (index / TAGGED_PREFIXES)))
+        {
+            failed = "tagged add";
+        }
+        if (!failed && index < TAGGED_PREFIXES && prefixdb_add_binary(plain, addresses[index], lengths[index], NULL))
+        {
+            failed = "plain add";
+        }
+    }
+    if (!failed && (prefixdb_save_binary(pfdb, &data1, &size1, 0) || !(loaded = prefixdb_load_binary(data1, size1, 0))))
+    {
+        failed = "loaded image";
+    }
+    for (count = 0; !failed && count < TAGGED_SEARCHES; count ++)
+    {
+        address = (count % 2) ? addresses[rand() % (TAGGED_LISTS * TAGGED_PREFIXES)] | (rand() & 0xff) : (((uint32_t)rand() << 16) ^ (uint32_t)rand());
+        for (index = 0, expected = 0; index < TAGGED_LISTS * TAGGED_PREFIXES; index ++)
+        {
+            if (!((address ^ addresses[index]) & (0xffffffff << (32 - lengths[index]))))
+            {
+                expected |= (uint64_t)1 << (index / TAGGED_PREFIXES);
+            }
+        }
+        if (prefixdb_search_binary_tagged(pfdb, address, &tags) != (expected ? PREFIXDB_ERROR_OK : PREFIXDB_ERROR_NOTFOUND) || tags != expected)
+        {
+            failed = "lists masks";
+        }
+        else if (prefixdb_search_binary_tagged(loaded, address, &ltags) != (expected ? PREFIXDB_ERROR_OK : PREFIXDB_ERROR_NOTFOUND) || ltags != expected)
+        {
+            failed = "loaded lists masks";
+        }
+        matched += (expected != 0);
+    }
+    prefixdb_free(&loaded);
+    if (!failed)
+    {
+        prefixdb_stats(pfdb, &stats);
+        prefixdb_free(&pfdb);
+        pfdb = prefixdb_allocate();
+        for (index = 0; !failed && index < TAGGED_PREFIXES; index ++)
+        {
+            if (prefixdb_add_binary_tagged(pfdb, addresses[index], lengths[index], 1))
+            {
+                failed = "single list add";
+            }
+        }
+        if (!failed && (prefixdb_save_binary(pfdb, &data1, &size1, 0) || prefixdb_save_binary(plain, &data2, &size2, 0) ||
+                        size1 != size2 || memcmp(data1, data2, size1)))
+        {
+            failed = "single list layout";
         }
     }
     SW_END;
-    printf("\rsearch %6d addresses   %s [%.06fs] [%d searches/s - %d matched - %d unmatched]", SEARCHES_COUNT,
-           matches[2] ? "fail": "pass", SW_ELAPSED, (int)((double)SEARCHES_COUNT / SW_ELAPSED), matches[0], matches[1]);
-    for (count = 0; count < SEARCHES_COUNT / 25000; count ++) printf(" "); printf("\n");
-    exit |= (matches[2] ? 1 : 0);
+    printf("tagged lookups            %s%s%s [%.06fs] [%d lists - %u values - %d searches - %d matched]\n", failed ? "fail (" : "pass",
+           failed ? failed : "", failed ? ")" : "", SW_ELAPSED, TAGGED_LISTS, failed ? 0 : stats.values, TAGGED_SEARCHES, matched);
+    prefixdb_free(&pfdb);
+    prefixdb_free(&plain);
+    return failed ? 1 : 0;
+}
 
-    SW_START; status = prefixdb_free(&pfdb); SW_END;
-    printf("release database          %s [%.06fs]\n", status == PREFIXDB_ERROR_OK ? "pass" : "fail", SW_ELAPSED);
-    exit |= (status != PREFIXDB_ERROR_OK ? 1 : 0);
+// check lookups in a sparse database (mostly host routes, where long chains of single-child nodes become skip entries)
+// against a brute-force scan of its prefixes, with single, batched and prefiltered searches, before and after serialization
+#define  SPARSE_PREFIXES  (2000)
+#define  SPARSE_SEARCHES  (20000)
+static int prefixdb_bench_sparse()
+{
+    static const char *passes[] = { "trie", "image", "prefiltered" };
+    PREFIXDB       *pfdb;
+    PREFIXDBSTATS  stats;
+    struct timeval begin, end;
+    uint32_t       prefixes[SPARSE_PREFIXES], addresses[SPARSE_SEARCHES], index, count;
+    uint8_t        lengths[SPARSE_PREFIXES], expected[SPARSE_SEARCHES], results[SPARSE_SEARCHES];
+    const char     *failed = NULL;
+    char           name[32];
+    int            matched = 0, pass;
 
-    unlink("/tmp/bench.pfdb");
-    return exit;
+    pfdb = prefixdb_allocate();
+    SW_START;
+    for (index = 0; index < SPARSE_PREFIXES; index ++)
+    {
+        lengths[index]  = (index % 4) ? 32 : (rand() % 9) + 20;
+        prefixes[index] = (((uint32_t)rand() << 16) ^ (uint32_t)rand()) & (0xffffffff << (32 - lengths[index]));
+        if (!failed && prefixdb_add_binary(pfdb, prefixes[index], lengths[index], NULL) != PREFIXDB_ERROR_OK)
+        {
+            failed = "add";
+        }
+    }
+    for (count = 0; count < SPARSE_SEARCHES; count ++)
+    {
+        addresses[count] = (count % 2) ? prefixes[rand() % SPARSE_PREFIXES] ^ (1 << (rand() % 12)) : (((uint32_t)rand() << 16) ^ (uint32_t)rand());
+        expected[count]  = PREFIXDB_ERROR_NOTFOUND;
+        for (index = 0; index < SPARSE_PREFIXES; index ++)
+        {
+            if (!((addresses[count] ^ prefixes[index]) & (0xffffffff << (32 - lengths[index]))))
+            {
+                expected[count] = PREFIXDB_ERROR_OK;
+                matched ++;
+                break;
+            }
+        }
+    }
+    // build trie lookups first, then image lookups without and with a prefilter
+    for (pass = 0; pass < 3 && !failed; pass ++)
+    {
+        if      (pass == 1 && prefixdb_save_binary(pfdb, NULL, NULL, 0) != PREFIXDB_ERROR_OK)                 failed = "serialize";
+        else if (prefixdb_set_flags(pfdb, PREFIXDB_FLAGS_PREFILTER, pass == 2) != PREFIXDB_ERROR_OK)             failed = "prefilter";
+        else if (prefixdb_search_binary_batch(pfdb, addresses, SPARSE_SEARCHES, results) != PREFIXDB_ERROR_OK) failed = "batch";
+        for (count = 0; !failed && count < SPARSE_SEARCHES; count ++)
+        {
+            if      (prefixdb_search_binary(pfdb, addresses[count], NULL) != expected[count]) failed = "searches";
+            else if (results[count] != expected[count])                                    failed = "batch";
+        }
+        if (failed)
+        {
+            snprintf(name, sizeof(name), "%s %s", passes[pass], failed);
+            failed = name;
+        }
+    }
+    if (!failed && prefixdb_stats(pfdb, &stats) != PREFIXDB_ERROR_OK)
+    {
+        failed = "statistics";
+    }
+    SW_END;
+    printf("sparse lookups            %s%s%s [%.06fs] [%d prefixes - %u nodes - %u skips - %d searches - %d matched]\n", failed ? "fail (" : "pass",
+           failed ? failed : "", failed ? ")" : "", SW_ELAPSED, SPARSE_PREFIXES, failed ? 0 : stats.nodes, failed ? 0 : stats.skips, SPARSE_SEARCHES,
+           matched);
+    prefixdb_free(&pfdb);
+    return failed ? 1 : 0;
 }
 
-int prefixdb_import(char *list, char *database)
+// check that freezing a database keeps its lookups while releasing the build trie, that thawing it serializes back to the same
+// image, and that adding to a loaded database keeps the prefixes it was loaded with
+#define  FREEZE_PREFIXES  (20000)
+#define  FREEZE_SEARCHES  (20000)
+static int prefixdb_bench_freeze()
 {
-    PREFIXDB *pfdb = prefixdb_allocate();
+    PREFIXDB       *pfdb, *loaded = NULL;
+    PREFIXDBSTATS  stats;
+    struct timeval begin, end;
+    uint32_t       addresses[FREEZE_SEARCHES], size1, size2, index, address;
+    uint8_t        results[FREEZE_SEARCHES], frozen[FREEZE_SEARCHES], *image = NULL, *data1, *data2, length;
+    uint64_t       memory = 0;
+    const char     *failed = NULL;
+
+    pfdb = prefixdb_allocate();
+    SW_START;
+    for (index = 0; index < FREEZE_PREFIXES; index ++)
+    {
+        length = (rand() % 21) + 8;
+        if (!failed && prefixdb_add_binary_tagged(pfdb, (((uint32_t)rand() << 16) ^ (uint32_t)rand()) & (0xffffffff << (32 - length)), length,
+                                                  (uint64_t)1 << (rand() % 2)) != PREFIXDB_ERROR_OK)
+        {
+            failed = "add";
+        }
+    }
+    for (index = 0; index < FREEZE_SEARCHES; index ++)
+    {
+        addresses[index] = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+    }
+    if (!failed)
+    {
+        if      (prefixdb_search_binary_batch(pfdb, addresses, FREEZE_SEARCHES, results)) failed = "searches";
+        else if (prefixdb_save_binary(pfdb, &image, &size1, PREFIXDB_FLAGS_COPY))         failed = "image";
+        else if (prefixdb_stats(pfdb, &stats))                                            failed = "statistics";
+    }
+    memory = failed ? 0 : stats.memory;
+    if (!failed)
+    {
+        if      (prefixdb_freeze(pfdb) || prefixdb_stats(pfdb, &stats)) failed = "freeze";
+        else if (stats.trie_nodes)                                      failed = "build trie released";
+    }
+    if (!failed && (prefixdb_search_binary_batch(pfdb, addresses, FREEZE_SEARCHES, frozen) || memcmp(results, frozen, FREEZE_SEARCHES)))
+    {
+        failed = "frozen searches";
+    }
+    if (!failed && (prefixdb_thaw(pfdb) || prefixdb_save_binary(pfdb, &data2, &size2, 0) || size1 != size2 || memcmp(image, data2, size1)))
+    {
+        failed = "thawed image";
+    }
+    if (!failed)
+    {
+        // the same prefix added to the original database and to a copy loaded from its image
+        address = (((uint32_t)rand() << 16) ^ (uint32_t)rand()) & 0xffffff00;
+        if (!(loaded = prefixdb_load_binary(image, size1, PREFIXDB_FLAGS_COPY)) ||
+            prefixdb_add_binary_tagged(pfdb, address, 24, 4) || prefixdb_add_binary_tagged(loaded, address, 24, 4))
+        {
+            failed = "add after load";
+        }
+        else if (prefixdb_save_binary(pfdb, &data1, &size1, PREFIXDB_FLAGS_FREEZE) || prefixdb_save_binary(loaded, &data2, &size2, 0) ||
+                 size1 != size2 || memcmp(data1, data2, size1))
+        {
+            failed = "loaded image";
+        }
+    }
+    SW_END;
+    printf("freeze and thaw           %s%s%s [%.06fs] [%d prefixes - %lu bytes before - %lu bytes frozen]\n", failed ? "fail (" : "pass",
+           failed ? failed : "", failed ? ")" : "", SW_ELAPSED, FREEZE_PREFIXES, (unsigned long)memory, (unsigned long)(failed ? 0 : stats.memory));
+    prefixdb_free(&loaded);
+    prefixdb_free(&pfdb);
+    free(image);
+    return failed ? 1 : 0;
+}
+
+// interleave adds and searches on a large database (answered from the build trie, without serializing it for each search),
+// then check the build trie answers against the image ones
+#define  LIVE_PREFIXES  (100000)
+#define  LIVE_ROUNDS    (20000)
+static int prefixdb_bench_live()
+{
+    PREFIXDB       *pfdb;
+    struct timeval begin, end;
+    uint32_t       addresses[LIVE_ROUNDS], index, address;
+    uint8_t        results[LIVE_ROUNDS], serialized[LIVE_ROUNDS], length;
+    const char     *failed = NULL;
 
-    return prefixdb_add_file(pfdb, list) == PREFIXDB_ERROR_OK &&
-           prefixdb_save_file(pfdb, database) == PREFIXDB_ERROR_OK &&
-           prefixdb_free(&pfdb) == PREFIXDB_ERROR_OK ? 0 : 1;
+    pfdb = prefixdb_allocate();
+    for (index = 0; index < LIVE_PREFIXES; index ++)
+    {
+        length = (rand() % 13) + 16;
+        if (!failed && prefixdb_add_binary(pfdb, (((uint32_t)rand() << 16) ^ (uint32_t)rand()) & (0xffffffff << (32 - length)), length, NULL))
+        {
+            failed = "add";
+        }
+    }
+    if (!failed && prefixdb_save_binary(pfdb, NULL, NULL, 0))
+    {
+        failed = "serialize";
+    }
+    SW_START;
+    for (index = 0; index < LIVE_ROUNDS && !failed; index ++)
+    {
+        address = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+        if      (prefixdb_add_binary(pfdb, address & 0xffffff00, 24, NULL))          failed = "interleaved add";
+        else if (prefixdb_search_binary(pfdb, address, NULL) != PREFIXDB_ERROR_OK) failed = "added prefix search";
+        addresses[index] = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+        prefixdb_search_binary(pfdb, addresses[index], NULL);
+    }
+    SW_END;
+    if (!failed && (prefixdb_search_binary_batch(pfdb, addresses, LIVE_ROUNDS, results) || prefixdb_save_binary(pfdb, NULL, NULL, 0) ||
+                    prefixdb_search_binary_batch(pfdb, addresses, LIVE_ROUNDS, serialized) || memcmp(results, serialized, LIVE_ROUNDS)))
+    {
+        failed = "trie and image searches";
+    }
+    printf("interleaved add/search    %s%s%s [%.06fs] [%d prefixes - %d rounds/s]\n", failed ? "fail (" : "pass", failed ? failed : "",
+           failed ? ")" : "", SW_ELAPSED, LIVE_PREFIXES, (int)((double)LIVE_ROUNDS / SW_ELAPSED));
+    prefixdb_free(&pfdb);
+    return failed ? 1 : 0;
 }
 
-int prefixdb_search(char *database, char **addresses)
+// build the same database with individual and batched inserts (both images must be identical)
+#define  BATCH_PREFIXES  (200000)
+static int prefixdb_bench_batch()
 {
-   PREFIXDB *pfdb = prefixdb_load_file(database, 0);
+    PREFIXDB       *single, *batch;
+    struct timeval begin, end;
+    uint32_t       *addresses, size1, size2, index;
+    uint8_t        *lengths, *data1, *data2;
+    double         elapsed;
+    const char     *failed = NULL;
 
-   while (*addresses)
-   {
-       printf("%-15.15s  %s\n", *addresses, prefixdb_search_string(pfdb, *addresses, NULL) == PREFIXDB_ERROR_OK ? "matched": "-");
-       addresses ++;
-   }
-   prefixdb_free(&pfdb);
-   return 0;
+    addresses = (uint32_t *)malloc(BATCH_PREFIXES * sizeof(uint32_t));
+    lengths   = (uint8_t *)malloc(BATCH_PREFIXES * sizeof(uint8_t));
+    single    = prefixdb_allocate();
+    batch     = prefixdb_allocate();
+    if (!addresses || !lengths || !single || !batch)
+    {
+        failed = "setup";
+    }
+    for (index = 0; index < BATCH_PREFIXES && !failed; index ++)
+    {
+        addresses[index] = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+        lengths[index]   = (rand() % 13) + 20;
+    }
+    SW_START;
+    for (index = 0; index < BATCH_PREFIXES && !failed; index ++)
+    {
+        if (prefixdb_add_binary(single, addresses[index], lengths[index], NULL))
+        {
+            failed = "single add";
+        }
+    }
+    SW_END;
+    elapsed = SW_ELAPSED;
+    SW_START; if (!failed && prefixdb_add_binary_batch(batch, addresses, lengths, BATCH_PREFIXES)) failed = "batched add"; SW_END;
+    if (!failed && (prefixdb_save_binary(single, &data1, &size1, 0) || prefixdb_save_binary(batch, &data2, &size2, 0) || size1 != size2 ||
+                    memcmp(data1, data2, size1)))
+    {
+        failed = "identical images";
+    }
+    printf("batch insert              %s%s%s [%.06fs] [%d prefixes - %d inserts/s batched - %d inserts/s single]\n", failed ? "fail (" : "pass",
+           failed ? failed : "", failed ? ")" : "", SW_ELAPSED, BATCH_PREFIXES, (int)((double)BATCH_PREFIXES / SW_ELAPSED),
+           (int)((double)BATCH_PREFIXES / elapsed));
+    prefixdb_free(&single);
+    prefixdb_free(&batch);
+    free(addresses);
+    free(lengths);
+    return failed ? 1 : 0;
 }
 
-int main(int argc, char **argv)
+// check overlap queries against the inserted prefixes: a query finds nothing exactly when none of them overlaps it, and the
+// addresses of a query matching the database are the ones lying inside the reported prefixes
+#define  OVERLAP_PREFIXES  (5000)
+#define  OVERLAP_QUERIES   (5000)
+#define  OVERLAP_REPORTED  (64)
+typedef struct
 {
-    if (argc < 2)
+    uint32_t count, prefixes[OVERLAP_REPORTED];
+    uint8_t  lengths[OVERLAP_REPORTED];
+} OVERLAP_RESULTS;
+
+static int prefixdb_bench_overlap_collect(uint32_t address, uint8_t length, uint64_t tags, void *context)
+{
+    OVERLAP_RESULTS *results = (OVERLAP_RESULTS *)context;
+
+    if (results->count < OVERLAP_REPORTED)
     {
-        return prefixdb_help();
+        results->prefixes[results->count] = address;
+        results->lengths[results->count]  = length;
     }
-    while (*(argv[1]) == '-') argv[1] ++;
-    if (!strncasecmp(argv[1], "help", strlen(argv[1])))
+    results->count ++;
+    return 0;
+}
+
+static int prefixdb_bench_overlap()
+{
+    PREFIXDB        *pfdb;
+    OVERLAP_RESULTS results;
+    struct timeval  begin, end;
+    uint32_t        prefixes[OVERLAP_PREFIXES], query, address, mask, index, count, reported, item;
+    uint8_t         lengths[OVERLAP_PREFIXES], length, overlaps, expected, inside;
+    const char      *failed = NULL;
+    int             found, covered = 0, contained = 0;
+
+    pfdb = prefixdb_allocate();
+    for (index = 0; index < OVERLAP_PREFIXES; index ++)
     {
-        return prefixdb_help();
+        lengths[index]  = (rand() % 17) + 12;
+        prefixes[index] = (((uint32_t)rand() << 16) ^ (uint32_t)rand()) & (0xffffffff << (32 - lengths[index]));
+        if (!failed && prefixdb_add_binary(pfdb, prefixes[index], lengths[index], NULL))
+        {
+            failed = "add";
+        }
     }
-    else if (!strncasecmp(argv[1], "bench", strlen(argv[1])))
+    SW_START;
+    for (count = 0; count < OVERLAP_QUERIES && !failed; count ++)
     {
-        return prefixdb_bench();
+        length = (rand() % 25) + 8;
+        query  = ((count % 2) ? prefixes[rand() % OVERLAP_PREFIXES] : (((uint32_t)rand() << 16) ^ (uint32_t)rand())) & (0xffffffff << (32 - length));
+        memset(&results, 0, sizeof(results));
+        found  = prefixdb_overlap_binary(pfdb, query, length, &overlaps, prefixdb_bench_overlap_collect, &results);
+        for (index = 0, expected = 0; index < OVERLAP_PREFIXES; index ++)
+        {
+            mask      = 0xffffffff << (32 - (lengths[index] < length ? lengths[index] : length));
+            expected |= !((query ^ prefixes[index]) & mask);
+        }
+        if      (found != PREFIXDB_ERROR_OK && found != PREFIXDB_ERROR_NOTFOUND) failed = "query";
+        else if ((found == PREFIXDB_ERROR_OK) != expected)                     failed = "overlap found";
+        else if ((found == PREFIXDB_ERROR_OK) != (results.count != 0))         failed = "reported prefixes";
+        else if ((overlaps & PREFIXDB_OVERLAP_COVERED) && results.count != 1)  failed = "covering prefix";
+        covered   += (overlaps & PREFIXDB_OVERLAP_COVERED) ? 1 : 0;
+        contained += (overlaps & PREFIXDB_OVERLAP_INSIDE) ? 1 : 0;
+        reported   = results.count < OVERLAP_REPORTED ? results.count : OVERLAP_REPORTED;
+        for (index = 0; index < reported && !failed; index ++)
+        {
+            mask = 0xffffffff << (32 - (results.lengths[index] < length ? results.lengths[index] : length));
+            if (((query ^ results.prefixes[index]) & mask) != 0 || ((overlaps & PREFIXDB_OVERLAP_COVERED) != 0) != (results.lengths[index] <= length))
+            {
+                failed = "reported prefix";
+            }
+        }
+        for (index = 0; index < 16 && results.count <= OVERLAP_REPORTED && !failed; index ++)
+        {
+            address = query | (length < 32 ? ((((uint32_t)rand() << 16) ^ (uint32_t)rand()) & ~(0xffffffff << (32 - length))) : 0);
+            for (inside = 0, item = 0; item < reported; item ++)
+            {
+                inside |= !((address ^ results.prefixes[item]) & (0xffffffff << (32 - results.lengths[item])));
+            }
+            if ((prefixdb_search_binary(pfdb, address, NULL) == PREFIXDB_ERROR_OK) != inside)
+            {
+                failed = "addresses inside";
+            }
+        }
     }
-    else if (!strncasecmp(argv[1], "import", strlen(argv[1])))
+    SW_END;
+    printf("overlap queries           %s%s%s [%.06fs] [%d prefixes - %d queries - %d covered - %d containing]\n", failed ? "fail (" : "pass",
+           failed ? failed : "", failed ? ")" : "", SW_ELAPSED, OVERLAP_PREFIXES, OVERLAP_QUERIES, covered, contained);
+    prefixdb_free(&pfdb);
+    return failed ? 1 : 0;
+}
+
+// check covered addresses counts (whole space, per-/8 breakdown and random CIDRs) against the merged inserted prefixes ranges
+#define  COVERAGE_PREFIXES  (200000)
+#define  COVERAGE_QUERIES   (200)
+static int prefixdb_bench_coverage_compare(const void *first, const void *second)
+{
+    return *(uint64_t *)first < *(uint64_t *)second ? -1 : (*(uint64_t *)first > *(uint64_t *)second ? 1 : 0);
+}
+
+static int prefixdb_bench_coverage()
+{
+    PREFIXDB       *pfdb;
+    struct timeval begin, end;
+    uint64_t       *keys, *ranges, *buckets, *expected, total, counted, covered = 0, first, last, low, high;
+    uint32_t       index, count = 0, query, bucket;
+    uint8_t        length;
+    const char     *failed = NULL;
+
+    keys     = (uint64_t *)malloc(COVERAGE_PREFIXES * sizeof(uint64_t));
+    ranges   = (uint64_t *)malloc(COVERAGE_PREFIXES * 2 * sizeof(uint64_t));
+    buckets  = (uint64_t *)malloc(65536 * sizeof(uint64_t));
+    expected = (uint64_t *)calloc(256, sizeof(uint64_t));
+    if (!(pfdb = prefixdb_allocate()) || !keys || !ranges || !buckets || !expected)
     {
-        return (argc != 4) ? prefixdb_help() : prefixdb_import(argv[2], argv[3]);
+        failed = "setup";
     }
-    else if (!strncasecmp(argv[1], "search", strlen(argv[1])))
+    for (index = 0; index < COVERAGE_PREFIXES && !failed; index ++)
     {
-        return (argc < 4) ? prefixdb_help() : prefixdb_search(argv[2], argv + 3);
+        length = (rand() % 17) + 16;
+        query  = (((uint32_t)rand() << 16) ^ (uint32_t)rand()) & (0xffffffff << (32 - length));
+        if (prefixdb_add_binary(pfdb, query, length, NULL))
+        {
+            failed = "add";
+        }
+        keys[index] = ((uint64_t)query << 32) | (32 - length);
+    }
+    if (!failed)
+    {
+        qsort(keys, COVERAGE_PREFIXES, sizeof(uint64_t), prefixdb_bench_coverage_compare);
+        for (index = 0; index < COVERAGE_PREFIXES; index ++)
+        {
+            first = keys[index] >> 32;
+            last  = first + ((uint64_t)1 << (keys[index] & 0xff));
+            if (count && first <= ranges[(count * 2) - 1])
+            {
+                ranges[(count * 2) - 1] = last > ranges[(count * 2) - 1] ? last : ranges[(count * 2) - 1];
+            }
+            else
+            {
+                ranges[count * 2]       = first;
+                ranges[(count * 2) + 1] = last;
+                count ++;
+            }
+        }
+        for (index = 0, total = 0; index < count; index ++)
+        {
+            total += ranges[(index * 2) + 1] - ranges[index * 2];
+            for (bucket = ranges[index * 2] >> 24; bucket < 256 && ((uint64_t)bucket << 24) < ranges[(index * 2) + 1]; bucket ++)
+            {
+                low  = ranges[index * 2] > ((uint64_t)bucket << 24) ? ranges[index * 2] : ((uint64_t)bucket << 24);
+                high = ranges[(index * 2) + 1] < ((uint64_t)(bucket + 1) << 24) ? ranges[(index * 2) + 1] : ((uint64_t)(bucket + 1) << 24);
+                expected[bucket] += high - low;
+            }
+        }
+        if (prefixdb_save_binary(pfdb, NULL, NULL, 0) != PREFIXDB_ERROR_OK)
+        {
+            failed = "serialize";
+        }
+    }
+    SW_START;
+    if (!failed && prefixdb_coverage(pfdb, 0, 0, 0, &counted, 16, buckets) != PREFIXDB_ERROR_OK)
+    {
+        failed = "/16 breakdown";
+    }
+    SW_END;
+    if (!failed)
+    {
+        covered = counted;
+        for (bucket = 0, low = 0; bucket < 65536; bucket ++)
+        {
+            low += buckets[bucket];
+        }
+        if      (counted != total) failed = "whole space";
+        else if (low != total)     failed = "/16 breakdown total";
+        else if (prefixdb_coverage(pfdb, 0, 0, 0, &counted, 8, buckets) != PREFIXDB_ERROR_OK || memcmp(buckets, expected, 256 * sizeof(uint64_t)))
+        {
+            failed = "/8 breakdown";
+        }
+        for (query = 0; query < COVERAGE_QUERIES && !failed; query ++)
+        {
+            length = (rand() % 25) + 8;
+            first  = (((uint32_t)rand() << 16) ^ (uint32_t)rand()) & (0xffffffff << (32 - length));
+            last   = first + ((uint64_t)1 << (32 - length));
+            for (index = 0, total = 0; index < count; index ++)
+            {
+                low    = ranges[index * 2] > first ? ranges[index * 2] : first;
+                high   = ranges[(index * 2) + 1] < last ? ranges[(index * 2) + 1] : last;
+                total += high > low ? high - low : 0;
+            }
+            if (prefixdb_coverage(pfdb, first, length, 0, &counted, 0, NULL) != PREFIXDB_ERROR_OK || counted != total)
+            {
+                failed = "random CIDRs";
+            }
+        }
+    }
+    printf("coverage counting         %s%s%s [%.06fs] [%d prefixes - %lu addresses covered - /16 breakdown]\n", failed ? "fail (" : "pass",
+           failed ? failed : "", failed ? ")" : "", SW_ELAPSED, COVERAGE_PREFIXES, (unsigned long)covered);
+    prefixdb_free(&pfdb);
+    free(keys);
+    free(ranges);
+    free(buckets);
+    free(expected);
+    return failed ? 1 : 0;
+}
+
+// diff two databases sharing most of their prefixes, then patch a copy loaded from the first image, which must end up with the
+// very same image as the second one
+#define  DELTA_PREFIXES  (100000)
+#define  DELTA_CHANGES   (100)
+static int prefixdb_bench_delta()
+{
+    PREFIXDB       *old, *new, *loaded = NULL, *rejected = NULL;
+    struct timeval begin, end;
+    uint32_t       *prefixes, index, size, old_size, new_size, patched_size;
+    uint8_t        *lengths, *delta = NULL, *image = NULL, *new_data, *patched;
+    const char     *failed = NULL;
+
+    prefixes = (uint32_t *)malloc(DELTA_PREFIXES * sizeof(uint32_t));
+    lengths  = (uint8_t *)malloc(DELTA_PREFIXES * sizeof(uint8_t));
+    old      = prefixdb_allocate();
+    new      = prefixdb_allocate();
+    if (!prefixes || !lengths || !old || !new)
+    {
+        failed = "setup";
+    }
+    for (index = 0; index < DELTA_PREFIXES && !failed; index ++)
+    {
+        lengths[index]  = (rand() % 13) + 16;
+        prefixes[index] = (((uint32_t)rand() << 16) ^ (uint32_t)rand()) & (0xffffffff << (32 - lengths[index]));
+        if ((index < DELTA_PREFIXES - DELTA_CHANGES && prefixdb_add_binary_tagged(old, prefixes[index], lengths[index], (uint64_t)1 << (index % 2))) ||
+            (index >= DELTA_CHANGES && prefixdb_add_binary_tagged(new, prefixes[index], lengths[index], (uint64_t)1 << (index % 2))))
+        {
+            failed = "add";
+        }
+    }
+    if (!failed && (prefixdb_save_binary(old, &image, &old_size, PREFIXDB_FLAGS_COPY) || !(loaded = prefixdb_load_binary(image, old_size, PREFIXDB_FLAGS_COPY))))
+    {
+        failed = "base image";
+    }
+    SW_START;
+    if (!failed)
+    {
+        if      (prefixdb_diff(old, new, &delta, &size)) failed = "diff";
+        else if (prefixdb_patch(loaded, delta, size))    failed = "patch";
+    }
+    SW_END;
+    if (!failed && (prefixdb_save_binary(new, &new_data, &new_size, 0) || prefixdb_save_binary(loaded, &patched, &patched_size, 0) ||
+                    new_size != patched_size || memcmp(new_data, patched, new_size)))
+    {
+        failed = "patched image";
+    }
+    if (!failed && prefixdb_patch(loaded, delta, size) != PREFIXDB_ERROR_ACCESS)
+    {
+        failed = "base image checksum";
+    }
+
+    // a delta whose last added leaf lists were altered no longer yields the result image, leaving the database untouched
+    if (!failed)
+    {
+        delta[size - 1] ^= 4;
+        if (!(rejected = prefixdb_load_binary(image, old_size, PREFIXDB_FLAGS_COPY)) || prefixdb_patch(rejected, delta, size) != PREFIXDB_ERROR_CHECKSUM ||
+            prefixdb_save_binary(rejected, &patched, &patched_size, 0) || patched_size != old_size || memcmp(patched, image, old_size))
+        {
+            failed = "rejected patch";
+        }
+    }
+    printf("delta and patch           %s%s%s [%.06fs] [%d prefixes - %d changed - %u bytes image - %u bytes delta]\n", failed ? "fail (" : "pass",
+           failed ? failed : "", failed ? ")" : "", SW_ELAPSED, DELTA_PREFIXES, DELTA_CHANGES * 2, failed ? 0 : new_size, failed ? 0 : size);
+    prefixdb_free(&loaded);
+    prefixdb_free(&rejected);
+    prefixdb_free(&old);
+    prefixdb_free(&new);
+    free(image);
+    free(delta);
+    free(prefixes);
+    free(lengths);
+    return failed ? 1 : 0;
+}
+
+// diff against a target saved in the v1 layout (rebuilt here from the nodes and values sections of the v2 image of every
+// tagged /10 prefix, which has no skip entries) and patch: the result is the current layout image of the same prefixes
+#define  LEGACY_PREFIXES  (1024)
+static int prefixdb_bench_legacy()
+{
+    PREFIXDB       *base, *target, *legacy = NULL, *patched = NULL;
+    PREFIXDBSTATS  stats;
+    struct timeval begin, end;
+    uint32_t       index, value, size, legacy_size = 0, delta_size, target_size, patched_size, nodes = 0, values = 0;
+    uint8_t        *image, *section, *data = NULL, *delta = NULL, *target_data, *patched_data;
+    const char     *failed = NULL;
+
+    base   = prefixdb_allocate();
+    target = prefixdb_allocate();
+    for (index = 0; index < LEGACY_PREFIXES && !failed; index ++)
+    {
+        if (prefixdb_add_binary_tagged(base, index << 22, 10, (uint64_t)1 << (index % 2)) ||
+            prefixdb_add_binary_tagged(target, index << 22, 10, (index % 5) ? (uint64_t)1 << (index % 2) : 3))
+        {
+            failed = "add";
+        }
+    }
+    SW_START;
+    if (!failed && (prefixdb_save_binary(target, &image, &size, 0) || prefixdb_stats(target, &stats) || stats.skips))
+    {
+        failed = "target image";
+    }
+    if (!failed)
+    {
+        // v1 images are the nodes records and the values table, followed by a 31-bytes trailer (12 reserved zero bytes, values
+        // count, records size in bits, nodes count, version, file size and the v2 header magic marker)
+        for (index = 0; index < image[7]; index ++)
+        {
+            section = image + 64 + (index * 16);
+            memcpy(&value, section, 4);
+            if      (ntohl(value) == 1) nodes  = index + 1;
+            else if (ntohl(value) == 2) values = index + 1;
+        }
+        memcpy(&value, image + 64 + ((nodes - 1) * 16) + 8, 4);
+        legacy_size = ntohl(value) + (stats.values * 8) + 31;
+        if (!nodes || (stats.values && !values) || !(data = (uint8_t *)calloc(legacy_size, 1)))
+        {
+            failed = "v1 image";
+        }
+    }
+    if (!failed)
+    {
+        memcpy(&value, image + 64 + ((nodes - 1) * 16) + 4, 4);
+        memcpy(data, image + ntohl(value), legacy_size - (stats.values * 8) - 31);
+        if (values)
+        {
+            memcpy(&value, image + 64 + ((values - 1) * 16) + 4, 4);
+            memcpy(data + legacy_size - (stats.values * 8) - 31, image + ntohl(value), stats.values * 8);
+        }
+        value = htonl(stats.values);              memcpy(data + legacy_size - 19, &value, 4);
+        data[legacy_size - 15] = image[6];
+        memcpy(data + legacy_size - 14, image + 8, 4);
+        data[legacy_size - 10] = 0x01;
+        data[legacy_size - 9]  = stats.values ? 0x02 : 0x01;
+        value = htonl(legacy_size);               memcpy(data + legacy_size - 8, &value, 4);
+        memcpy(data + legacy_size - 4, image, 4);
+        if (!(legacy = prefixdb_load_binary(data, legacy_size, 0)) || prefixdb_stats(legacy, &stats) || stats.version >= 0x0200)
+        {
+            failed = "v1 image";
+        }
+    }
+    if (!failed)
+    {
+        if      (prefixdb_diff(base, legacy, &delta, &delta_size))                                             failed = "diff";
+        else if (prefixdb_save_binary(base, &image, &size, 0) || !(patched = prefixdb_load_binary(image, size, PREFIXDB_FLAGS_COPY))) failed = "base image";
+        else if (prefixdb_patch(patched, delta, delta_size))                                                   failed = "patch";
+        else if (prefixdb_save_binary(target, &target_data, &target_size, 0) || prefixdb_save_binary(patched, &patched_data, &patched_size, 0) ||
+                 target_size != patched_size || memcmp(target_data, patched_data, target_size))                failed = "patched image";
+    }
+    SW_END;
+    printf("delta from v1 image       %s%s%s [%.06fs] [%d prefixes - %u bytes v1 image - %u bytes delta]\n", failed ? "fail (" : "pass",
+           failed ? failed : "", failed ? ")" : "", SW_ELAPSED, LEGACY_PREFIXES, failed ? 0 : legacy_size, failed ? 0 : delta_size);
+    prefixdb_free(&base);
+    prefixdb_free(&target);
+    prefixdb_free(&legacy);
+    prefixdb_free(&patched);
+    free(data);
+    free(delta);
+    return failed ? 1 : 0;
+}
+
+// check exact hit counts on a small database, then measure the searches overhead of counters on the bench database
+static int prefixdb_bench_counters()
+{
+    PREFIXDB      *pfdb;
+    PREFIXDBHITS   hits[4], *all = NULL;
+    PREFIXDBSTATS  stats;
+    struct timeval begin, end;
+    uint64_t       total = 0;
+    uint32_t       count, index;
+    uint32_t       *keys, found[2];
+    double         elapsed[2];
+    const char     *failed = NULL;
+    int            pass, round;
+
+    pfdb = prefixdb_allocate();
+    if (prefixdb_add_string(pfdb, "10.0.0.0/8", NULL) || prefixdb_add_string(pfdb, "192.168.1.0/24", NULL) ||
+        prefixdb_add_string_tagged(pfdb, "192.168.2.128/25", 2) || prefixdb_save_binary(pfdb, NULL, NULL, 0) ||
+        prefixdb_set_flags(pfdb, PREFIXDB_FLAGS_COUNTERS, 1))
+    {
+        failed = "setup";
+    }
+    for (index = 0; index < 1000 && !failed; index ++)
+    {
+        if      (prefixdb_search_binary(pfdb, 0x0a000000 | (index * 7919), NULL) != PREFIXDB_ERROR_OK)                         failed = "searches";
+        else if (!(index % 2) && prefixdb_search_binary(pfdb, 0xc0a80280 | (index % 128), NULL) != PREFIXDB_ERROR_OK)        failed = "searches";
+        else if (!(index % 10) && prefixdb_search_binary(pfdb, 0xc0a80300 | (index % 256), NULL) != PREFIXDB_ERROR_NOTFOUND) failed = "searches";
+    }
+    if (!failed && (prefixdb_counters_top(pfdb, hits, 4, &count) || count != 2 || hits[0].hits != 1000 || hits[0].address != 0x0a000000 ||
+                    hits[0].length != 8 || hits[1].hits != 500 || hits[1].address != 0xc0a80280 || hits[1].length != 25 || hits[1].tags != 2))
+    {
+        failed = "exact hits";
+    }
+    if (!failed && (prefixdb_counters_reset(pfdb) || prefixdb_counters_top(pfdb, hits, 4, &count) || count))
+    {
+        failed = "reset";
+    }
+    prefixdb_free(&pfdb);
+
+    // the same searches without then with counters (best of 3 interleaved runs), the total hits being the number of matches
+    pfdb = prefixdb_load_file("/tmp/bench.pfdb", 0);
+    keys = (uint32_t *)malloc(SEARCHES_COUNT * sizeof(uint32_t));
+    if (!failed && (!pfdb || !keys))
+    {
+        failed = "setup";
+    }
+    for (index = 0; keys && index < SEARCHES_COUNT; index ++)
+    {
+        keys[index] = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+    }
+    elapsed[0] = elapsed[1] = 0;
+    for (round = 0; round < 6 && !failed; round ++)
+    {
+        pass = round % 2;
+        if (prefixdb_set_flags(pfdb, PREFIXDB_FLAGS_COUNTERS, pass) || (pass && round > 1 && prefixdb_counters_reset(pfdb)))
+        {
+            failed = "counters flag";
+        }
+        found[pass] = 0;
+        SW_START;
+        for (index = 0; index < SEARCHES_COUNT; index ++)
+        {
+            found[pass] += prefixdb_search_binary(pfdb, keys[index], NULL) == PREFIXDB_ERROR_OK;
+        }
+        SW_END;
+        elapsed[pass] = (!elapsed[pass] || SW_ELAPSED < elapsed[pass]) ? SW_ELAPSED : elapsed[pass];
+    }
+    free(keys);
+    if (!failed)
+    {
+        if      (prefixdb_stats(pfdb, &stats)) failed = "statistics";
+        else if (found[0] != found[1])         failed = "counted searches";
+        else if (!(all = (PREFIXDBHITS *)malloc(stats.leaves * sizeof(PREFIXDBHITS))) || prefixdb_counters_top(pfdb, all, stats.leaves, &count))
+        {
+            failed = "top";
+        }
+    }
+    for (index = 0; !failed && index < count; index ++)
+    {
+        total += all[index].hits;
+        if (index && all[index].hits > all[index - 1].hits)
+        {
+            failed = "top order";
+        }
+    }
+    if (!failed && total != found[1])
+    {
+        failed = "total hits";
+    }
+    free(all);
+    printf("hit counters              %s%s%s [%d searches/s - %d searches/s counted - %.02f%% overhead - %u bytes]\n", failed ? "fail (" : "pass",
+           failed ? failed : "", failed ? ")" : "", (int)(SEARCHES_COUNT / elapsed[0]), (int)(SEARCHES_COUNT / elapsed[1]),
+           failed ? 0 : (elapsed[1] - elapsed[0]) * 100 / elapsed[0], failed ? 0 : stats.counters_size);
+    prefixdb_free(&pfdb);
+    return failed ? 1 : 0;
+}
+
+// compare the lookup engines against the trie on the same data: identical results (and lists) for every key, searches/s of
+// the best of 3 runs and engine memory
+#define  ENGINES_SEARCHES  (500000)
+#define  ENGINES_DATABASE  "/tmp/bench-engines.pfdb"
+static int prefixdb_bench_engines_on(PREFIXDB *pfdb, const char *data, uint32_t *keys)
+{
+    PREFIXDBSTATS  stats;
+    struct timeval begin, end;
+    uint64_t       *tags, value;
+    uint32_t       index, round;
+    uint8_t        *expected, engine;
+    double         elapsed, best[sizeof(prefixdb_engines) / sizeof(char *)];
+    const char     *failed = NULL;
+    char           label[32];
+
+    expected = (uint8_t *)malloc(ENGINES_SEARCHES * sizeof(uint8_t));
+    tags     = (uint64_t *)calloc(ENGINES_SEARCHES, sizeof(uint64_t));
+    for (engine = 0; engine < sizeof(prefixdb_engines) / sizeof(char *) && expected && tags; engine ++)
+    {
+        if (prefixdb_set_engine(pfdb, engine) || prefixdb_stats(pfdb, &stats) || stats.engine != engine)
+        {
+            failed = "selection";
+        }
+        for (index = 0; index < ENGINES_SEARCHES && !failed; index ++)
+        {
+            value = 0;
+            if (!engine)
+            {
+                expected[index] = prefixdb_search_binary_tagged(pfdb, keys[index], tags + index);
+            }
+            else if (prefixdb_search_binary_tagged(pfdb, keys[index], &value) != expected[index])
+            {
+                failed = "results";
+            }
+            else if (value != tags[index])
+            {
+                failed = "lists";
+            }
+        }
+        for (round = 0, best[engine] = 0; round < 3 && !failed; round ++)
+        {
+            SW_START;
+            for (index = 0; index < ENGINES_SEARCHES; index ++)
+            {
+                prefixdb_search_binary(pfdb, keys[index], NULL);
+            }
+            SW_END;
+            elapsed      = SW_ELAPSED;
+            best[engine] = (!best[engine] || elapsed < best[engine]) ? elapsed : best[engine];
+        }
+        if (engine)
+        {
+            sprintf(label, "engine %s (%s)", prefixdb_engines[engine], data);
+            printf("%-26.26s%s%s%s [trie %d searches/s - %s %d searches/s - %u bytes]\n", label, failed ? "fail (" : "pass", failed ? failed : "",
+                   failed ? ")" : "", (int)(ENGINES_SEARCHES / best[0]), prefixdb_engines[engine], failed ? 0 : (int)(ENGINES_SEARCHES / best[engine]),
+                   stats.engine_size);
+        }
+        if (failed)
+        {
+            break;
+        }
+    }
+    if (!expected || !tags || prefixdb_set_engine(pfdb, PREFIXDB_ENGINE_TRIE))
+    {
+        failed = "setup";
+    }
+    free(expected);
+    free(tags);
+    return failed ? 1 : 0;
+}
+
+static int prefixdb_bench_engines()
+{
+    PREFIXDB      *pfdb, *loaded = NULL;
+    PREFIXDBSTATS stats;
+    uint64_t      tags[2];
+    uint32_t      *keys, *prefixes, index, size;
+    uint8_t       *image = NULL, length, engine;
+    const char    *failed = NULL;
+    char          name[32];
+    int           status = 0;
+
+    keys     = (uint32_t *)malloc(ENGINES_SEARCHES * sizeof(uint32_t));
+    prefixes = (uint32_t *)malloc(ENGINES_SEARCHES * sizeof(uint32_t));
+    if (!keys || !prefixes || !(pfdb = prefixdb_load_file("/tmp/bench.pfdb", 0)))
+    {
+        free(keys);
+        free(prefixes);
+        return 1;
+    }
+    for (index = 0; index < ENGINES_SEARCHES; index ++)
+    {
+        keys[index] = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+    }
+    status |= prefixdb_bench_engines_on(pfdb, "bench", keys);
+    prefixdb_free(&pfdb);
+
+    // long (mostly /28 to /32) tagged prefixes, searched around them
+    pfdb = prefixdb_allocate();
+    for (index = 0; index < ENGINES_SEARCHES / 2 && !failed; index ++)
+    {
+        length          = (rand() % 9) + 24;
+        prefixes[index] = (((uint32_t)rand() << 16) ^ (uint32_t)rand()) & (0xffffffff << (32 - length));
+        if (prefixdb_add_binary_tagged(pfdb, prefixes[index], length, (uint64_t)1 << (index % 3)))
+        {
+            failed = "add";
+        }
+    }
+    for (index = 0; index < ENGINES_SEARCHES; index ++)
+    {
+        keys[index] = (index % 2) ? prefixes[rand() % (ENGINES_SEARCHES / 2)] ^ (rand() % 256) : (((uint32_t)rand() << 16) ^ (uint32_t)rand());
+    }
+    if (!failed && prefixdb_save_binary(pfdb, NULL, NULL, 0))
+    {
+        failed = "serialize";
+    }
+    status |= failed || prefixdb_bench_engines_on(pfdb, "long", keys);
+
+    // the engine (and its structures) is recorded in saved images, and loaded back with them, mapped files included
+    for (engine = 1; engine < sizeof(prefixdb_engines) / sizeof(char *) && !failed && !status; engine ++)
+    {
+        if (prefixdb_set_engine(pfdb, engine) || prefixdb_save_binary(pfdb, &image, &size, PREFIXDB_FLAGS_COPY) ||
+            !(loaded = prefixdb_load_binary(image, size, 0)) || prefixdb_stats(loaded, &stats) || stats.engine != engine ||
+            !stats.engine_size || prefixdb_verify(loaded))
+        {
+            failed = "loaded image";
+        }
+        prefixdb_free(&loaded);
+        free(image);
+        image = NULL;
+        if (!failed && (prefixdb_save_file(pfdb, ENGINES_DATABASE) || !(loaded = prefixdb_load_file(ENGINES_DATABASE, PREFIXDB_FLAGS_MMAP))))
+        {
+            failed = "mapped image";
+        }
+        for (index = 0; index < ENGINES_SEARCHES && !failed; index ++)
+        {
+            tags[0] = tags[1] = 0;
+            if (prefixdb_search_binary_tagged(loaded, keys[index], tags) != prefixdb_search_binary_tagged(pfdb, keys[index], tags + 1) ||
+                tags[0] != tags[1])
+            {
+                failed = "mapped results";
+            }
+        }
+        prefixdb_free(&loaded);
+        if (failed)
+        {
+            snprintf(name, sizeof(name), "%s %s", prefixdb_engines[engine], failed);
+            failed = name;
+        }
+    }
+    unlink(ENGINES_DATABASE);
+    printf("engines selection         %s%s%s%s\n", failed || status ? "fail" : "pass", failed ? " (" : "", failed ? failed : "", failed ? ")" : "");
+    prefixdb_free(&pfdb);
+    free(keys);
+    free(prefixes);
+    return failed || status ? 1 : 0;
+}
+
+int prefixdb_bench(int zipf)
+{
+    PREFIXDB        *pfdb, *copy = NULL;
+    PREFIXDBSTATS   stats;
+    PREFIXDBMETRICS metrics;
+    struct timeval  begin, end;
+    uint32_t        *keys = NULL, size1, size2;
+    uint8_t         *data1, *data2;
+    char            address[30], label[32];
+    unsigned int    seed;
+    int             exit = 0, status, matches[3], pmatches[3], count;
+
+    SW_START; pfdb = prefixdb_allocate(); SW_END;
+    printf("allocate empty database   %s [%.06fs]\n", pfdb ? "pass" : "fail", SW_ELAPSED);
+    exit |= (!pfdb ? 1 : 0);
+
+    printf("add %6d prefixes       ", PREFIXES_COUNT); fflush(stdout);
+    status = 0; srand(time(NULL) + getpid());
+    SW_START;
+    for (count = 0; count < PREFIXES_COUNT; count ++)
+    {
+        sprintf(address, "%d.%d.%d.%d/%d", (rand() % 223) + 1, (rand() % 223) + 1, (rand() % 223) + 1, (rand() % 223) + 1, (rand() % 12) + 16);
+        status |= prefixdb_add_string(pfdb, address, NULL);
+        if (count && !(count % 25000))
+        {
+            printf("."); fflush(stdout);
+        }
+    }
+    SW_END;
+    printf("\radd %6d prefixes       %s [%.06fs] [%d prefixes/s]", PREFIXES_COUNT, status ? "fail" : "pass", SW_ELAPSED, (int)((double)PREFIXES_COUNT / SW_ELAPSED));
+    for (count = 0; count < PREFIXES_COUNT / 25000; count ++) printf(" "); printf("\n");
+    exit |= (status ? 1 : 0);
+
+    SW_START; status = prefixdb_save_file(pfdb, "/tmp/bench.pfdb"); SW_END;
+    printf("save database             %s [%.06fs]\n", status == PREFIXDB_ERROR_OK ? "pass" : "fail", SW_ELAPSED);
+    exit |= (status != PREFIXDB_ERROR_OK ? 1 : 0);
+
+    SW_START; status = prefixdb_free(&pfdb); SW_END;
+    printf("release database          %s [%.06fs]\n", status == PREFIXDB_ERROR_OK ? "pass" : "fail", SW_ELAPSED);
+    exit |= (status != PREFIXDB_ERROR_OK ? 1 : 0);
+
+    SW_START; pfdb = prefixdb_load_file("/tmp/bench.pfdb", 0); SW_END;
+    printf("load database             %s [%.06fs]\n", pfdb ? "pass" : "fail", SW_ELAPSED);
+    exit |= (!pfdb ? 1 : 0);
+
+    SW_START;
+    status = !pfdb || prefixdb_save_file(pfdb, "/tmp/bench-copy.pfdb") != PREFIXDB_ERROR_OK || !(copy = prefixdb_load_file("/tmp/bench-copy.pfdb", 0)) ||
+             prefixdb_save_binary(pfdb, &data1, &size1, 0) || prefixdb_save_binary(copy, &data2, &size2, 0) || size1 != size2 || memcmp(data1, data2, size1);
+    SW_END;
+    printf("save loaded database      %s [%.06fs]\n", status ? "fail" : "pass", SW_ELAPSED);
+    exit |= status;
+    prefixdb_free(&copy);
+    unlink("/tmp/bench-copy.pfdb");
+
+    seed = rand();
+    if (zipf)
+    {
+        if (!(keys = prefixdb_bench_zipf()))
+        {
+            return 1;
+        }
+        sprintf(label, "search %6d zipfian", SEARCHES_COUNT);
+        exit |= prefixdb_bench_search(pfdb, label, seed, keys, matches);
+
+        prefixdb_set_flags(pfdb, PREFIXDB_FLAGS_CACHE, 1);
+        sprintf(label, "search %6d (cache)", SEARCHES_COUNT);
+        status = prefixdb_bench_search(pfdb, label, seed, keys, pmatches) || pmatches[0] != matches[0] || pmatches[1] != matches[1];
+        prefixdb_stats(pfdb, &stats);
+        printf("cache statistics          %s [%d bytes - %.02f%% hits]\n", status ? "fail" : "pass", stats.cache_size,
+               (stats.cache_hits + stats.cache_misses) ? (double)stats.cache_hits * 100 / (stats.cache_hits + stats.cache_misses) : 0);
+        exit |= status;
+        free(keys);
+    }
+    else
+    {
+        sprintf(label, "search %6d addresses", SEARCHES_COUNT);
+        exit |= prefixdb_bench_search(pfdb, label, seed, NULL, matches);
+
+        prefixdb_set_flags(pfdb, PREFIXDB_FLAGS_METRICS, 1);
+        sprintf(label, "search %6d (metrics)", SEARCHES_COUNT);
+        status = prefixdb_bench_search(pfdb, label, seed, NULL, pmatches) || pmatches[0] != matches[0] || pmatches[1] != matches[1];
+        prefixdb_set_flags(pfdb, PREFIXDB_FLAGS_METRICS, 0);
+        prefixdb_metrics(pfdb, &metrics);
+        status |= (metrics.searches.count != SEARCHES_COUNT || metrics.matches != matches[0]);
+        printf("metrics statistics        %s [p50 %luns - p99 %luns - p99.9 %luns - %.02f average depth]\n", status ? "fail" : "pass",
+               (unsigned long)prefixdb_metrics_percentile(&(metrics.searches), 50), (unsigned long)prefixdb_metrics_percentile(&(metrics.searches), 99),
+               (unsigned long)prefixdb_metrics_percentile(&(metrics.searches), 99.9), metrics.searches.count ? (double)metrics.depths / metrics.searches.count : 0);
+        exit |= status;
+
+        SW_START; status = prefixdb_set_flags(pfdb, PREFIXDB_FLAGS_PREFILTER, 1); SW_END;
+        printf("build prefilter           %s [%.06fs]\n", status == PREFIXDB_ERROR_OK ? "pass" : "fail", SW_ELAPSED);
+        exit |= (status != PREFIXDB_ERROR_OK ? 1 : 0);
+
+        sprintf(label, "search %6d (prefilter)", SEARCHES_COUNT);
+        status = prefixdb_bench_search(pfdb, label, seed, NULL, pmatches) || pmatches[0] != matches[0] || pmatches[1] != matches[1];
+        prefixdb_stats(pfdb, &stats);
+        printf("prefilter statistics      %s [%d bytes - %.02f%% coverage - %.02f%% rejected]\n", status ? "fail" : "pass",
+               stats.prefilter_size, (double)stats.prefilter_coverage * 100 / (stats.prefilter_size * 8),
+               stats.prefilter_checked ? (double)stats.prefilter_rejected * 100 / stats.prefilter_checked : 0);
+        exit |= status;
+    }
+
+    SW_START; status = prefixdb_free(&pfdb); SW_END;
+    printf("release database          %s [%.06fs]\n", status == PREFIXDB_ERROR_OK ? "pass" : "fail", SW_ELAPSED);
+    exit |= (status != PREFIXDB_ERROR_OK ? 1 : 0);
+
+    exit |= prefixdb_bench_tagged();
+    exit |= prefixdb_bench_sparse();
+    exit |= prefixdb_bench_freeze();
+    exit |= prefixdb_bench_live();
+    exit |= prefixdb_bench_batch();
+    exit |= prefixdb_bench_overlap();
+    exit |= prefixdb_bench_coverage();
+    exit |= prefixdb_bench_delta();
+    exit |= prefixdb_bench_legacy();
+    exit |= prefixdb_bench_counters();
+    exit |= prefixdb_bench_engines();
+
+    unlink("/tmp/bench.pfdb");
+    return exit;
+}
+
+int prefixdb_import(char **lists, int count, char *database)
+{
+    PREFIXDB *pfdb = prefixdb_allocate();
+    int      index, status = (count > 64);
+
+    for (index = 0; index < count && !status; index ++)
+    {
+        if (prefixdb_add_file_tagged(pfdb, lists[index], (uint64_t)1 << index) != PREFIXDB_ERROR_OK)
+        {
+            fprintf(stderr, "cannot import prefixes list \"%s\"\n", lists[index]);
+            status = 1;
+        }
+    }
+    status = status || prefixdb_save_file(pfdb, database) != PREFIXDB_ERROR_OK;
+    prefixdb_free(&pfdb);
+    return status;
+}
+
+int prefixdb_search(char *database, char **addresses)
+{
+   PREFIXDB      *pfdb = prefixdb_load_file(database, 0);
+   PREFIXDBSTATS stats;
+   uint64_t      tags;
+   int           list;
+
+   if (!pfdb || prefixdb_stats(pfdb, &stats) != PREFIXDB_ERROR_OK)
+   {
+       fprintf(stderr, "cannot open or invalid PrefixDB database \"%s\"\n", database);
+       prefixdb_free(&pfdb);
+       return 1;
+   }
+   while (*addresses)
+   {
+       printf("%-15.15s  %s", *addresses, prefixdb_search_string_tagged(pfdb, *addresses, &tags) == PREFIXDB_ERROR_OK ? "matched": "-");
+       for (list = 0; stats.values && list < 64; list ++)
+       {
+           if (tags & ((uint64_t)1 << list))
+           {
+               printf(" %d", list + 1);
+           }
+       }
+       printf("\n");
+       addresses ++;
+   }
+   prefixdb_free(&pfdb);
+   return 0;
+}
+
+typedef struct
+{
+    int tagged;
+} OVERLAP_OUTPUT;
+
+static int prefixdb_overlap_print(uint32_t address, uint8_t length, uint64_t tags, void *context)
+{
+    char prefix[32];
+    int  list;
+
+    snprintf(prefix, sizeof(prefix), "%u.%u.%u.%u/%u", address >> 24, (address >> 16) & 0xff, (address >> 8) & 0xff, address & 0xff, length);
+    printf(((OVERLAP_OUTPUT *)context)->tagged ? "  %-18s" : "  %s", prefix);
+    for (list = 0; ((OVERLAP_OUTPUT *)context)->tagged && list < 64; list ++)
+    {
+        if (tags & ((uint64_t)1 << list))
+        {
+            printf(" %d", list + 1);
+        }
+    }
+    printf("\n");
+    return 0;
+}
+
+int prefixdb_overlap(char *database, char **prefixes)
+{
+    PREFIXDB       *pfdb = prefixdb_load_file(database, 0);
+    PREFIXDBSTATS  stats;
+    OVERLAP_OUTPUT output;
+    uint8_t        overlaps;
+    int            status;
+
+    if (!pfdb || prefixdb_stats(pfdb, &stats) != PREFIXDB_ERROR_OK)
+    {
+        fprintf(stderr, "cannot open or invalid PrefixDB database \"%s\"\n", database);
+        prefixdb_free(&pfdb);
+        return 1;
+    }
+    output.tagged = stats.values != 0;
+    while (*prefixes)
+    {
+        // the stored prefix covering the queried one is known before it is printed, those inside it are printed as found
+        if ((status = prefixdb_overlap_string(pfdb, *prefixes, &overlaps, NULL, NULL)) == PREFIXDB_ERROR_PARAM)
+        {
+            printf("%-18.18s  invalid\n", *prefixes);
+        }
+        else
+        {
+            printf("%-18.18s  %s\n", *prefixes, (overlaps & PREFIXDB_OVERLAP_COVERED) ? "covered" : ((overlaps & PREFIXDB_OVERLAP_INSIDE) ? "containing" : "-"));
+            if (status == PREFIXDB_ERROR_OK)
+            {
+                prefixdb_overlap_string(pfdb, *prefixes, NULL, prefixdb_overlap_print, &output);
+            }
+        }
+        prefixes ++;
+    }
+    prefixdb_free(&pfdb);
+    return 0;
+}
+
+int prefixdb_diff_files(char *base, char *target)
+{
+    PREFIXDB *old = prefixdb_load_file(base, 0), *new = prefixdb_load_file(target, 0);
+    uint8_t  *delta = NULL;
+    uint32_t size;
+    int      status = 1;
+
+    if (!old || !new)
+    {
+        fprintf(stderr, "cannot open or invalid PrefixDB database \"%s\"\n", !old ? base : target);
+    }
+    else if (isatty(STDOUT_FILENO))
+    {
+        fprintf(stderr, "not writing a binary delta to a terminal\n");
+    }
+    else if (prefixdb_diff(old, new, &delta, &size) != PREFIXDB_ERROR_OK || fwrite(delta, 1, size, stdout) != size || fflush(stdout))
+    {
+        fprintf(stderr, "cannot compute or write the delta between \"%s\" and \"%s\"\n", base, target);
+    }
+    else
+    {
+        fprintf(stderr, "%u removed - %u added - %u bytes\n", ntohl(*(uint32_t *)(delta + 8)), ntohl(*(uint32_t *)(delta + 12)), size);
+        status = 0;
+    }
+    free(delta);
+    prefixdb_free(&old);
+    prefixdb_free(&new);
+    return status;
+}
+
+int prefixdb_patch_file(char *database, char *path, char *output)
+{
+    PREFIXDB    *pfdb = prefixdb_load_file(database, 0);
+    struct stat info;
+    uint8_t     *delta = NULL;
+    int         handle = -1, status = 1;
+
+    if (!pfdb)
+    {
+        fprintf(stderr, "cannot open or invalid PrefixDB database \"%s\"\n", database);
+    }
+    else if ((handle = open(path, O_RDONLY)) < 0 || fstat(handle, &info) < 0 || !(delta = (uint8_t *)malloc(info.st_size + 1)) ||
+             read(handle, delta, info.st_size) != info.st_size)
+    {
+        fprintf(stderr, "cannot read delta \"%s\"\n", path);
+    }
+    else if ((status = prefixdb_patch(pfdb, delta, info.st_size)) != PREFIXDB_ERROR_OK)
+    {
+        fprintf(stderr, "%s \"%s\" to \"%s\"\n", status == PREFIXDB_ERROR_ACCESS ? "mismatching delta base, cannot apply" :
+                status == PREFIXDB_ERROR_CHECKSUM ? "mismatching delta result (corrupted delta), cannot apply" : "cannot apply delta", path, database);
+        status = 1;
+    }
+    else if (prefixdb_save_file(pfdb, output ? output : database) != PREFIXDB_ERROR_OK)
+    {
+        fprintf(stderr, "cannot save PrefixDB database \"%s\"\n", output ? output : database);
+        status = 1;
+    }
+    if (handle >= 0)
+    {
+        close(handle);
+    }
+    free(delta);
+    prefixdb_free(&pfdb);
+    return status;
+}
+
+int prefixdb_top(char *database, int count)
+{
+    PREFIXDB      *pfdb = prefixdb_load_file(database, 0);
+    PREFIXDBSTATS stats;
+    PREFIXDBHITS  *hits;
+    uint32_t      address, found, index;
+    char          line[128], prefix[32];
+    int           list;
+
+    if (!pfdb || prefixdb_stats(pfdb, &stats) != PREFIXDB_ERROR_OK || prefixdb_set_flags(pfdb, PREFIXDB_FLAGS_COUNTERS, 1) != PREFIXDB_ERROR_OK)
+    {
+        fprintf(stderr, "cannot open or invalid PrefixDB database \"%s\"\n", database);
+        prefixdb_free(&pfdb);
+        return 1;
+    }
+    if (count <= 0 || !(hits = (PREFIXDBHITS *)malloc(count * sizeof(PREFIXDBHITS))))
+    {
+        prefixdb_free(&pfdb);
+        return prefixdb_help();
+    }
+    while (fgets(line, sizeof(line), stdin))
+    {
+        if (prefixdb_parse_address(line, strlen(line), &address))
+        {
+            prefixdb_search_binary(pfdb, address, NULL);
+        }
+    }
+    prefixdb_counters_top(pfdb, hits, count, &found);
+    for (index = 0; index < found; index ++)
+    {
+        snprintf(prefix, sizeof(prefix), "%u.%u.%u.%u/%u", hits[index].address >> 24, (hits[index].address >> 16) & 0xff,
+                 (hits[index].address >> 8) & 0xff, hits[index].address & 0xff, hits[index].length);
+        printf("%-18s  %10lu", prefix, (unsigned long)hits[index].hits);
+        for (list = 0; stats.values && list < 64; list ++)
+        {
+            if (hits[index].tags & ((uint64_t)1 << list))
+            {
+                printf(" %d", list + 1);
+            }
+        }
+        printf("\n");
+    }
+    free(hits);
+    prefixdb_free(&pfdb);
+    return 0;
+}
+
+int prefixdb_engine(char *database, char *name)
+{
+    PREFIXDB *pfdb;
+    uint8_t  engine;
+
+    for (engine = 0; engine < sizeof(prefixdb_engines) / sizeof(char *) && strcasecmp(name, prefixdb_engines[engine]); engine ++);
+    if (engine >= sizeof(prefixdb_engines) / sizeof(char *))
+    {
+        return prefixdb_help();
+    }
+    if (!(pfdb = prefixdb_load_file(database, 0)))
+    {
+        fprintf(stderr, "cannot open or invalid PrefixDB database \"%s\"\n", database);
+        return 1;
+    }
+    if (prefixdb_set_engine(pfdb, engine) != PREFIXDB_ERROR_OK || prefixdb_save_file(pfdb, database) != PREFIXDB_ERROR_OK)
+    {
+        fprintf(stderr, "cannot save PrefixDB database \"%s\"\n", database);
+        prefixdb_free(&pfdb);
+        return 1;
+    }
+    prefixdb_free(&pfdb);
+    return 0;
+}
+
+int prefixdb_info(char *database)
+{
+    PREFIXDB      *pfdb;
+    PREFIXDBSTATS stats;
+    uint64_t      covered;
+    int           length;
+
+    if (!(pfdb = prefixdb_load_file(database, 0)) || prefixdb_stats(pfdb, &stats) != PREFIXDB_ERROR_OK)
+    {
+        fprintf(stderr, "cannot open or invalid PrefixDB database \"%s\"\n", database);
+        prefixdb_free(&pfdb);
+        return 1;
+    }
+    printf("database        %s\n", database);
+    printf("format          %u.%u%s\n", stats.version >> 8, stats.version & 0xff,
+           !stats.checksummed ? "" : (prefixdb_verify(pfdb) == PREFIXDB_ERROR_OK ? " (checksum ok)" : " (checksum MISMATCH)"));
+    printf("size            %u bytes\n", stats.data_size);
+    printf("memory          %lu bytes\n", (unsigned long)stats.memory);
+    printf("nodes           %u\n", stats.nodes);
+    printf("leaves          %u\n", stats.leaves);
+    if (stats.values)
+    {
+        printf("lists masks     %u\n", stats.values);
+    }
+    if (stats.skips)
+    {
+        printf("skip nodes      %u\n", stats.skips);
+    }
+    if (prefixdb_coverage(pfdb, 0, 0, 0, &covered, 0, NULL) == PREFIXDB_ERROR_OK)
+    {
+        printf("covered         %lu addresses (%.02f%%)\n", (unsigned long)covered, (double)covered * 100 / ((uint64_t)1 << 32));
+    }
+    printf("records size    %u bytes (%.02f bytes/node)\n", stats.records_size, (double)stats.records_size * 2);
+    if (stats.engine)
+    {
+        printf("engine          %s (%u bytes)\n", prefixdb_engines[stats.engine], stats.engine_size);
+    }
+    printf("lookup depth    %.02f average - %u max\n", stats.depth_average, stats.depth_max);
+    if (stats.trie_nodes)
+    {
+        printf("build trie      %u nodes - %lu bytes\n", stats.trie_nodes, (unsigned long)stats.trie_size);
+    }
+    printf("\nlength  prefixes  leaves at depth\n");
+    for (length = 1; length <= 32; length ++)
+    {
+        if (stats.lengths[length] || stats.depths[length])
+        {
+            printf("    %2d  %8u  %15u\n", length, stats.lengths[length], stats.depths[length]);
+        }
+    }
+    prefixdb_free(&pfdb);
+    return 0;
+}
+
+#define  STREAM_BLOCK    (4 << 20)
+#define  STREAM_BATCH    (256)
+#define  STREAM_WORKERS  (64)
+typedef struct
+{
+    PREFIXDB   *pfdb;
+    const char *separators;
+    char       *input, *output;
+    uint32_t   input_size, output_size, output_length, field;
+    int        lines, matching, status, threaded;
+    pthread_t  thread;
+} STREAM_WORKER;
+
+static int prefixdb_stream_output(STREAM_WORKER *worker, uint32_t size)
+{
+    char *output;
+
+    if (worker->output_length + size > worker->output_size)
+    {
+        if (!(output = (char *)realloc(worker->output, (worker->output_length + size) * 2)))
+        {
+            return -1;
+        }
+        worker->output      = output;
+        worker->output_size = (worker->output_length + size) * 2;
+    }
+    return 0;
+}
+
+static void prefixdb_stream_flush(STREAM_WORKER *worker, char **lines, uint32_t *lines_sizes, char **fields, uint32_t *fields_sizes,
+                                  uint32_t *addresses, uint8_t *valid, uint32_t count)
+{
+    uint8_t  results[STREAM_BATCH];
+    uint32_t index, size;
+    char     *output;
+
+    prefixdb_search_binary_batch(worker->pfdb, addresses, count, results);
+    for (index = 0; index < count; index ++)
+    {
+        results[index] = valid[index] && results[index] == PREFIXDB_ERROR_OK;
+        if (worker->matching && !results[index])
+        {
+            continue;
+        }
+        if (prefixdb_stream_output(worker, lines_sizes[index] + fields_sizes[index] + 32) < 0)
+        {
+            worker->status = 1;
+            return;
+        }
+        output = worker->output + worker->output_length;
+        if (worker->lines)
+        {
+            size = results[index] ? 8 : 2;
+            memcpy(output, results[index] ? "matched\t" : "-\t", size);
+            memcpy(output + size, lines[index], lines_sizes[index]);
+            size += lines_sizes[index];
+        }
+        else
+        {
+            size = fields_sizes[index] > 15 ? 15 : fields_sizes[index];
+            memcpy(output, fields[index], size);
+            while (size < 15)
+            {
+                output[size ++] = ' ';
+            }
+            memcpy(output + size, results[index] ? "  matched" : "  -", results[index] ? 9 : 3);
+            size += results[index] ? 9 : 3;
+        }
+        output[size ++]        = '\n';
+        worker->output_length += size;
+    }
+}
+
+// search all addresses of a block of complete lines, batching lookups and buffering output
+static void *prefixdb_stream_worker(void *argument)
+{
+    STREAM_WORKER *worker = (STREAM_WORKER *)argument;
+    uint32_t      addresses[STREAM_BATCH], lines_sizes[STREAM_BATCH], fields_sizes[STREAM_BATCH], count = 0, field, position = 0, end, start;
+    uint8_t       valid[STREAM_BATCH];
+    char          *lines[STREAM_BATCH], *fields[STREAM_BATCH], *input = worker->input, *newline;
+
+    worker->output_length = 0;
+    while (position < worker->input_size)
+    {
+        if (!(newline = memchr(input + position, '\n', worker->input_size - position)))
+        {
+            end = worker->input_size;
+        }
+        else
+        {
+            end = newline - input;
+        }
+        lines[count]       = input + position;
+        lines_sizes[count] = end - position;
+        if (lines_sizes[count] && input[end - 1] == '\r')
+        {
+            lines_sizes[count] --;
+        }
+        for (field = 0, start = position; ; field ++)
+        {
+            while (start < position + lines_sizes[count] && strchr(worker->separators, input[start]))
+            {
+                start ++;
+            }
+            fields[count] = input + start;
+            while (start < position + lines_sizes[count] && !strchr(worker->separators, input[start]))
+            {
+                start ++;
+            }
+            fields_sizes[count] = (input + start) - fields[count];
+            if (field + 1 >= worker->field || start >= position + lines_sizes[count])
+            {
+                break;
+            }
+        }
+        if (field + 1 != worker->field)
+        {
+            fields_sizes[count] = 0;
+        }
+        valid[count] = prefixdb_parse_address(fields[count], fields_sizes[count], &(addresses[count])) > 0;
+        if (!valid[count])
+        {
+            addresses[count] = 0;
+        }
+        position = end + 1;
+        if (lines_sizes[count] && ++ count == STREAM_BATCH)
+        {
+            prefixdb_stream_flush(worker, lines, lines_sizes, fields, fields_sizes, addresses, valid, count);
+            count = 0;
+        }
+    }
+    if (count)
+    {
+        prefixdb_stream_flush(worker, lines, lines_sizes, fields, fields_sizes, addresses, valid, count);
+    }
+    return NULL;
+}
+
+static int prefixdb_stream_write(const char *data, uint32_t size)
+{
+    ssize_t written;
+
+    while (size)
+    {
+        if ((written = write(1, data, size)) <= 0)
+        {
+            return -1;
+        }
+        data += written;
+        size -= written;
+    }
+    return 0;
+}
+
+int prefixdb_stream(int argc, char **argv)
+{
+    STREAM_WORKER workers[STREAM_WORKERS];
+    PREFIXDB      *pfdb;
+    const char    *separators = " \t";
+    ssize_t       bytes;
+    uint32_t      field = 1, threads = 1, carry = 0, index, running, last;
+    char          *previous;
+    int           option, input = 0, lines = 0, matching = 0, eof = 0, status = 0;
+
+    while ((option = getopt(argc, argv, "f:s:t:lm")) != -1)
+    {
+        switch (option)
+        {
+            case 'f': field      = strtoul(optarg, NULL, 10); break;
+            case 's': separators = optarg; break;
+            case 't': threads    = strtoul(optarg, NULL, 10); break;
+            case 'l': lines      = 1; break;
+            case 'm': matching   = 1; break;
+            default:  return prefixdb_help();
+        }
+    }
+    if (optind >= argc || optind + 2 < argc || !field || !threads || threads > STREAM_WORKERS)
+    {
+        return prefixdb_help();
+    }
+    if (!(pfdb = prefixdb_load_file(argv[optind], 0)))
+    {
+        fprintf(stderr, "cannot open or invalid PrefixDB database \"%s\"\n", argv[optind]);
+        return 1;
+    }
+    if (optind + 1 < argc && strcmp(argv[optind + 1], "-") && (input = open(argv[optind + 1], O_RDONLY)) < 0)
+    {
+        fprintf(stderr, "cannot open input file \"%s\"\n", argv[optind + 1]);
+        prefixdb_free(&pfdb);
+        return 1;
+    }
+    memset(workers, 0, sizeof(workers));
+    for (index = 0; index < threads; index ++)
+    {
+        workers[index].pfdb       = pfdb;
+        workers[index].separators = separators;
+        workers[index].field      = field;
+        workers[index].lines      = lines;
+        workers[index].matching   = matching;
+        if (!(workers[index].input = (char *)malloc(STREAM_BLOCK)))
+        {
+            status = 1;
+        }
+    }
+
+    // each round hands one block of complete lines to every worker, then writes their results back in input order
+    while (!status && !eof)
+    {
+        for (running = 0; running < threads && !eof; running ++)
+        {
+            // the incomplete line left at the end of the previous block starts this one
+            previous = running ? workers[running - 1].input : workers[threads - 1].input;
+            memmove(workers[running].input, previous + (running ? workers[running - 1].input_size : workers[threads - 1].input_size), carry);
+            workers[running].input_size = carry;
+            while (workers[running].input_size < STREAM_BLOCK)
+            {
+                if ((bytes = read(input, workers[running].input + workers[running].input_size, STREAM_BLOCK - workers[running].input_size)) <= 0)
+                {
+                    eof = 1;
+                    break;
+                }
+                workers[running].input_size += bytes;
+            }
+            carry = 0;
+            if (!eof)
+            {
+                for (last = workers[running].input_size; last && workers[running].input[last - 1] != '\n'; last --);
+                if (last)
+                {
+                    carry = workers[running].input_size - last;
+                    workers[running].input_size = last;
+                }
+            }
+        }
+        for (index = 0; index < running; index ++)
+        {
+            workers[index].threaded = running > 1 && !pthread_create(&(workers[index].thread), NULL, prefixdb_stream_worker, &(workers[index]));
+            if (!workers[index].threaded)
+            {
+                prefixdb_stream_worker(&(workers[index]));
+            }
+        }
+        for (index = 0; index < running; index ++)
+        {
+            if (workers[index].threaded)
+            {
+                pthread_join(workers[index].thread, NULL);
+            }
+            status |= workers[index].status || prefixdb_stream_write(workers[index].output, workers[index].output_length) < 0;
+        }
+    }
+
+    for (index = 0; index < threads; index ++)
+    {
+        free(workers[index].input);
+        free(workers[index].output);
+    }
+    if (input)
+    {
+        close(input);
+    }
+    prefixdb_free(&pfdb);
+    return status;
+}
+
+#define  SERVE_WORKERS   (64)
+#define  SERVE_EVENTS    (64)
+#define  SERVE_REQUEST   (4 + (PREFIXDB_PROTOCOL_BATCH * 4))
+#define  SERVE_SETTLE    (2)
+typedef struct
+{
+    int      handle;
+    uint32_t input_length, output_length, output_offset, output_size;
+    uint8_t  *input, *output;
+} SERVE_CONNECTION;
+typedef struct
+{
+    pthread_t thread;
+    uint64_t  state;
+    int       poller;
+    uint32_t  addresses[PREFIXDB_PROTOCOL_BATCH];
+    uint8_t   results[PREFIXDB_PROTOCOL_BATCH];
+} SERVE_WORKER;
+
+static PREFIXDB              *serve_database;
+static volatile sig_atomic_t serve_stopped;
+
+static void prefixdb_serve_stop(int signal)
+{
+    serve_stopped = 1;
+}
+
+static void prefixdb_serve_close(SERVE_WORKER *worker, SERVE_CONNECTION *connection)
+{
+    epoll_ctl(worker->poller, EPOLL_CTL_DEL, connection->handle, NULL);
+    close(connection->handle);
+    free(connection->input);
+    free(connection->output);
+    free(connection);
+}
+
+// answer all complete requests sitting in the connection input buffer, returns -1 on protocol or memory errors
+static int prefixdb_serve_process(SERVE_WORKER *worker, SERVE_CONNECTION *connection)
+{
+    PREFIXDB *pfdb = __atomic_load_n(&serve_database, __ATOMIC_ACQUIRE);
+    uint32_t count, size, consumed = 0, index;
+    uint8_t  *output, *response;
+
+    while (connection->input_length - consumed >= 4)
+    {
+        if (connection->input[consumed] != PREFIXDB_PROTOCOL_VERSION || connection->input[consumed + 1] != PREFIXDB_PROTOCOL_SEARCH)
+        {
+            return -1;
+        }
+        count = ntohs(*(uint16_t *)(connection->input + consumed + 2));
+        if (connection->input_length - consumed < 4 + (count * 4))
+        {
+            break;
+        }
+        size = 4 + ((count + 7) / 8);
+        if (connection->output_length + size > connection->output_size)
+        {
+            if (!(output = (uint8_t *)realloc(connection->output, (connection->output_length + size) * 2)))
+            {
+                return -1;
+            }
+            connection->output      = output;
+            connection->output_size = (connection->output_length + size) * 2;
+        }
+        for (index = 0; index < count; index ++)
+        {
+            worker->addresses[index] = ntohl(*(uint32_t *)(connection->input + consumed + 4 + (index * 4)));
+        }
+        response    = connection->output + connection->output_length;
+        response[0] = PREFIXDB_PROTOCOL_VERSION;
+        response[1] = count ? prefixdb_search_binary_batch(pfdb, worker->addresses, count, worker->results) : PREFIXDB_ERROR_OK;
+        *(uint16_t *)(response + 2) = htons(count);
+        memset(response + 4, 0, size - 4);
+        for (index = 0; index < count && response[1] == PREFIXDB_ERROR_OK; index ++)
+        {
+            if (worker->results[index] == PREFIXDB_ERROR_OK)
+            {
+                response[4 + (index / 8)] |= 1 << (index % 8);
+            }
+        }
+        if (response[1] != PREFIXDB_ERROR_OK)
+        {
+            size = 4;
+        }
+        connection->output_length += size;
+        consumed += 4 + (count * 4);
+    }
+    memmove(connection->input, connection->input + consumed, connection->input_length - consumed);
+    connection->input_length -= consumed;
+    return 0;
+}
+
+// push pending responses, and only listen for new requests once they are all sent (so slow readers cannot grow buffers)
+static int prefixdb_serve_flush(SERVE_WORKER *worker, SERVE_CONNECTION *connection)
+{
+    struct epoll_event event;
+    ssize_t            bytes;
+
+    while (connection->output_offset < connection->output_length)
+    {
+        if ((bytes = send(connection->handle, connection->output + connection->output_offset,
+                          connection->output_length - connection->output_offset, MSG_NOSIGNAL)) < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                break;
+            }
+            return -1;
+        }
+        connection->output_offset += bytes;
+    }
+    if (connection->output_offset >= connection->output_length)
+    {
+        connection->output_offset = connection->output_length = 0;
+    }
+    event.events   = connection->output_length ? EPOLLOUT : EPOLLIN;
+    event.data.ptr = connection;
+    return epoll_ctl(worker->poller, EPOLL_CTL_MOD, connection->handle, &event);
+}
+
+static void *prefixdb_serve_worker(void *argument)
+{
+    SERVE_WORKER       *worker = (SERVE_WORKER *)argument;
+    SERVE_CONNECTION   *connection;
+    struct epoll_event events[SERVE_EVENTS];
+    ssize_t            bytes;
+    int                count, index;
+
+    while (!serve_stopped)
+    {
+        // an even state tells the reloader this worker holds no reference to the database while it waits for events
+        if ((count = epoll_wait(worker->poller, events, SERVE_EVENTS, 1000)) <= 0)
+        {
+            continue;
+        }
+        __atomic_add_fetch(&(worker->state), 1, __ATOMIC_SEQ_CST);
+        for (index = 0; index < count; index ++)
+        {
+            connection = (SERVE_CONNECTION *)events[index].data.ptr;
+            if (events[index].events & EPOLLIN)
+            {
+                if ((bytes = recv(connection->handle, connection->input + connection->input_length, SERVE_REQUEST - connection->input_length, 0)) <= 0)
+                {
+                    if (!bytes || (errno != EAGAIN && errno != EWOULDBLOCK))
+                    {
+                        prefixdb_serve_close(worker, connection);
+                    }
+                    continue;
+                }
+                connection->input_length += bytes;
+                if (prefixdb_serve_process(worker, connection) < 0)
+                {
+                    prefixdb_serve_close(worker, connection);
+                    continue;
+                }
+            }
+            else if (events[index].events & (EPOLLHUP | EPOLLERR))
+            {
+                prefixdb_serve_close(worker, connection);
+                continue;
+            }
+            if (prefixdb_serve_flush(worker, connection) < 0)
+            {
+                prefixdb_serve_close(worker, connection);
+            }
+        }
+        __atomic_add_fetch(&(worker->state), 1, __ATOMIC_SEQ_CST);
+    }
+    return NULL;
+}
+
+// publish a new database and release the previous one once every worker has gone through a quiescent state
+static void prefixdb_serve_swap(SERVE_WORKER *workers, uint32_t threads, PREFIXDB *pfdb)
+{
+    PREFIXDB *previous = __atomic_exchange_n(&serve_database, pfdb, __ATOMIC_SEQ_CST);
+    uint64_t state;
+    uint32_t index;
+
+    for (index = 0; index < threads; index ++)
+    {
+        if ((state = __atomic_load_n(&(workers[index].state), __ATOMIC_SEQ_CST)) & 1)
+        {
+            while (__atomic_load_n(&(workers[index].state), __ATOMIC_SEQ_CST) == state)
+            {
+                usleep(100);
+            }
+        }
+    }
+    prefixdb_free(&previous);
+}
+
+int prefixdb_serve(int argc, char **argv)
+{
+    SERVE_WORKER       *workers;
+    SERVE_CONNECTION   *connection;
+    PREFIXDB           *pfdb;
+    struct sockaddr_un address;
+    struct epoll_event event;
+    struct sigaction   action;
+    struct stat        current, loaded;
+    uint32_t           threads = 1, index, next = 0;
+    int                option, listener, poller, handle, status = 0;
+
+    while ((option = getopt(argc, argv, "t:")) != -1)
+    {
+        switch (option)
+        {
+            case 't': threads = strtoul(optarg, NULL, 10); break;
+            default:  return prefixdb_help();
+        }
+    }
+    if (optind + 2 != argc || !threads || threads > SERVE_WORKERS || strlen(argv[optind + 1]) >= sizeof(address.sun_path))
+    {
+        return prefixdb_help();
+    }
+    if (stat(argv[optind], &loaded) < 0 || !(serve_database = prefixdb_load_file(argv[optind], PREFIXDB_FLAGS_MMAP)))
+    {
+        fprintf(stderr, "cannot open or invalid PrefixDB database \"%s\"\n", argv[optind]);
+        return 1;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, argv[optind + 1]);
+    unlink(address.sun_path);
+    if ((listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0)) < 0 || bind(listener, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+        listen(listener, 1024) < 0 || (poller = epoll_create1(0)) < 0)
+    {
+        fprintf(stderr, "cannot listen on socket \"%s\"\n", address.sun_path);
+        prefixdb_free(&serve_database);
+        return 1;
+    }
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = prefixdb_serve_stop;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    action.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &action, NULL);
+    event.events   = EPOLLIN;
+    event.data.ptr = NULL;
+    epoll_ctl(poller, EPOLL_CTL_ADD, listener, &event);
+    if (!(workers = (SERVE_WORKER *)calloc(threads, sizeof(SERVE_WORKER))))
+    {
+        status = 1;
+        threads = 0;
+    }
+    for (index = 0; index < threads; index ++)
+    {
+        if ((workers[index].poller = epoll_create1(0)) < 0 || pthread_create(&(workers[index].thread), NULL, prefixdb_serve_worker, &(workers[index])))
+        {
+            serve_stopped = status = 1;
+            threads = index;
+            break;
+        }
+    }
+    if (!status)
+    {
+        fprintf(stderr, "serving \"%s\" on \"%s\" with %u worker(s)\n", argv[optind], address.sun_path, threads);
+    }
+
+    // the main thread accepts connections (spread round-robin across workers) and watches the database file,
+    // which is only reloaded once it has stayed untouched for a few seconds, so that writers are done with it
+    // (the database is mapped shared rather than copied: prefixdb_save_file replaces it through a rename, so the
+    // previous mapping keeps reading the old file until the last worker is done with it)
+    while (!serve_stopped)
+    {
+        if (epoll_wait(poller, &event, 1, 1000) > 0)
+        {
+            while ((handle = accept(listener, NULL, NULL)) >= 0)
+            {
+                connection = NULL;
+                if (fcntl(handle, F_SETFL, fcntl(handle, F_GETFL) | O_NONBLOCK) < 0 ||
+                    !(connection = (SERVE_CONNECTION *)calloc(1, sizeof(SERVE_CONNECTION))) || !(connection->input = (uint8_t *)malloc(SERVE_REQUEST)))
+                {
+                    free(connection);
+                    close(handle);
+                    continue;
+                }
+                connection->handle = handle;
+                event.events       = EPOLLIN;
+                event.data.ptr     = connection;
+                if (epoll_ctl(workers[next ++ % threads].poller, EPOLL_CTL_ADD, handle, &event) < 0)
+                {
+                    free(connection->input);
+                    free(connection);
+                    close(handle);
+                }
+            }
+        }
+        if (!stat(argv[optind], &current) && time(NULL) - current.st_mtime >= SERVE_SETTLE &&
+            (current.st_ino != loaded.st_ino || current.st_dev != loaded.st_dev || current.st_mtime != loaded.st_mtime || current.st_size != loaded.st_size))
+        {
+            loaded = current;
+            if (!(pfdb = prefixdb_load_file(argv[optind], PREFIXDB_FLAGS_MMAP)))
+            {
+                fprintf(stderr, "cannot reload invalid PrefixDB database \"%s\", keeping the previous one\n", argv[optind]);
+                continue;
+            }
+            prefixdb_serve_swap(workers, threads, pfdb);
+            fprintf(stderr, "reloaded \"%s\"\n", argv[optind]);
+        }
+    }
+
+    serve_stopped = 1;
+    for (index = 0; index < threads; index ++)
+    {
+        pthread_join(workers[index].thread, NULL);
+        close(workers[index].poller);
+    }
+    free(workers);
+    close(poller);
+    close(listener);
+    unlink(address.sun_path);
+    prefixdb_free(&serve_database);
+    return status;
+}
+
+typedef struct
+{
+    const char *path;
+    pthread_t  thread;
+    uint64_t   requests, addresses, matches, elapsed;
+    uint32_t   batch, seed;
+    time_t     deadline;
+    int        status;
+} CLIENT_WORKER;
+
+static void *prefixdb_client_worker(void *argument)
+{
+    CLIENT_WORKER  *worker = (CLIENT_WORKER *)argument;
+    PREFIXDBCLIENT *client;
+    struct timeval begin, end;
+    uint32_t       *addresses, index;
+    uint8_t        *results;
+
+    addresses = (uint32_t *)malloc(worker->batch * sizeof(uint32_t));
+    results   = (uint8_t *)malloc(worker->batch);
+    if (!addresses || !results || !(client = prefixdb_client_open(worker->path)))
+    {
+        worker->status = 1;
+        free(addresses);
+        free(results);
+        return NULL;
+    }
+    while (time(NULL) < worker->deadline)
+    {
+        for (index = 0; index < worker->batch; index ++)
+        {
+            worker->seed ^= worker->seed << 13; worker->seed ^= worker->seed >> 17; worker->seed ^= worker->seed << 5;
+            addresses[index] = worker->seed;
+        }
+        SW_START;
+        if (prefixdb_client_search(client, addresses, worker->batch, results) != PREFIXDB_ERROR_OK)
+        {
+            worker->status = 1;
+            break;
+        }
+        SW_END;
+        worker->elapsed += ((end.tv_sec - begin.tv_sec) * 1000000) + (end.tv_usec - begin.tv_usec);
+        worker->requests ++;
+        worker->addresses += worker->batch;
+        for (index = 0; index < worker->batch; index ++)
+        {
+            worker->matches += results[index] == PREFIXDB_ERROR_OK;
+        }
+    }
+    prefixdb_client_close(&client);
+    free(addresses);
+    free(results);
+    return NULL;
+}
+
+int prefixdb_client(int argc, char **argv)
+{
+    CLIENT_WORKER  *workers;
+    PREFIXDBCLIENT *client;
+    uint64_t       requests = 0, addresses = 0, matches = 0, elapsed = 0;
+    uint32_t       connections = 4, batch = 64, duration = 10, index, address;
+    uint8_t        result;
+    int            option, status = 0;
+
+    while ((option = getopt(argc, argv, "c:b:d:")) != -1)
+    {
+        switch (option)
+        {
+            case 'c': connections = strtoul(optarg, NULL, 10); break;
+            case 'b': batch       = strtoul(optarg, NULL, 10); break;
+            case 'd': duration    = strtoul(optarg, NULL, 10); break;
+            default:  return prefixdb_help();
+        }
+    }
+    if (optind >= argc || !connections || !batch || batch > PREFIXDB_PROTOCOL_BATCH || !duration)
+    {
+        return prefixdb_help();
+    }
+    if (optind + 1 < argc)
+    {
+        if (!(client = prefixdb_client_open(argv[optind])))
+        {
+            fprintf(stderr, "cannot connect to socket \"%s\"\n", argv[optind]);
+            return 1;
+        }
+        for (index = optind + 1; index < argc && !status; index ++)
+        {
+            result = PREFIXDB_ERROR_NOTFOUND;
+            if (prefixdb_parse_address(argv[index], strlen(argv[index]), &address) == strlen(argv[index]) &&
+                (status = prefixdb_client_search(client, &address, 1, &result)) != PREFIXDB_ERROR_OK)
+            {
+                fprintf(stderr, "search failed through socket \"%s\"\n", argv[optind]);
+                break;
+            }
+            printf("%-15.15s  %s\n", argv[index], result == PREFIXDB_ERROR_OK ? "matched": "-");
+        }
+        prefixdb_client_close(&client);
+        return status ? 1 : 0;
+    }
+
+    if (!(workers = (CLIENT_WORKER *)calloc(connections, sizeof(CLIENT_WORKER))))
+    {
+        return 1;
+    }
+    for (index = 0; index < connections; index ++)
+    {
+        workers[index].path     = argv[optind];
+        workers[index].batch    = batch;
+        workers[index].seed     = 2463534242U + (index * 7919);
+        workers[index].deadline = time(NULL) + duration;
+        if (pthread_create(&(workers[index].thread), NULL, prefixdb_client_worker, &(workers[index])))
+        {
+            workers[index].status = -1;
+        }
+    }
+    for (index = 0; index < connections; index ++)
+    {
+        if (workers[index].status >= 0)
+        {
+            pthread_join(workers[index].thread, NULL);
+        }
+        status    |= workers[index].status;
+        requests  += workers[index].requests;
+        addresses += workers[index].addresses;
+        matches   += workers[index].matches;
+        elapsed   += workers[index].elapsed;
+    }
+    free(workers);
+    printf("%u connection(s) x %u addresses per request over %us: %.0f requests/s - %.0f searches/s - %.1fus average latency - %llu matched\n",
+           connections, batch, duration, (double)requests / duration, (double)addresses / duration,
+           requests ? (double)elapsed / requests : 0, (unsigned long long)matches);
+    if (status)
+    {
+        fprintf(stderr, "some connections to socket \"%s\" failed\n", argv[optind]);
+    }
+    return status ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        return prefixdb_help();
+    }
+    while (*(argv[1]) == '-') argv[1] ++;
+    if (!strncasecmp(argv[1], "help", strlen(argv[1])))
+    {
+        return prefixdb_help();
+    }
+    else if (!strncasecmp(argv[1], "bench", strlen(argv[1])))
+    {
+        return prefixdb_bench(argc > 2 && !strcasecmp(argv[2], "zipf"));
+    }
+    else if (!strncasecmp(argv[1], "import", strlen(argv[1])))
+    {
+        return (argc < 4) ? prefixdb_help() : prefixdb_import(argv + 2, argc - 3, argv[argc - 1]);
+    }
+    else if (!strncasecmp(argv[1], "search", strlen(argv[1])))
+    {
+        return (argc < 4) ? prefixdb_help() : prefixdb_search(argv[2], argv + 3);
+    }
+    else if (!strncasecmp(argv[1], "overlap", strlen(argv[1])))
+    {
+        return (argc < 4) ? prefixdb_help() : prefixdb_overlap(argv[2], argv + 3);
+    }
+    else if (!strncasecmp(argv[1], "info", strlen(argv[1])))
+    {
+        return (argc != 3) ? prefixdb_help() : prefixdb_info(argv[2]);
+    }
+    else if (!strncasecmp(argv[1], "diff", strlen(argv[1])))
+    {
+        return (argc != 4) ? prefixdb_help() : prefixdb_diff_files(argv[2], argv[3]);
+    }
+    else if (!strncasecmp(argv[1], "patch", strlen(argv[1])))
+    {
+        return (argc != 4 && argc != 5) ? prefixdb_help() : prefixdb_patch_file(argv[2], argv[3], argc == 5 ? argv[4] : NULL);
+    }
+    else if (!strncasecmp(argv[1], "top", strlen(argv[1])))
+    {
+        return (argc != 3 && argc != 4) ? prefixdb_help() : prefixdb_top(argv[2], argc == 4 ? atoi(argv[3]) : 20);
+    }
+    else if (!strncasecmp(argv[1], "engine", strlen(argv[1])))
+    {
+        return (argc != 4) ? prefixdb_help() : prefixdb_engine(argv[2], argv[3]);
+    }
+    else if (!strncasecmp(argv[1], "stream", strlen(argv[1])))
+    {
+        return prefixdb_stream(argc - 1, argv + 1);
+    }
+    else if (!strncasecmp(argv[1], "serve", strlen(argv[1])))
+    {
+        return prefixdb_serve(argc - 1, argv + 1);
+    }
+    else if (!strncasecmp(argv[1], "client", strlen(argv[1])))
+    {
+        return prefixdb_client(argc - 1, argv + 1);
     }
     return prefixdb_help();
 }
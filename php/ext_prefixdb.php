@@ -3,6 +3,10 @@
 {
     <<__Native("ZendCompat")>> public function __construct(string $path = null);
     <<__Native("ZendCompat")>> public function add(string $prefix): mixed;
+    <<__Native("ZendCompat")>> public function addBinary(int $address, int $length): mixed;
+    <<__Native("ZendCompat")>> public function addMany(array $prefixes): mixed;
+    <<__Native("ZendCompat")>> public function addFile(string $path): mixed;
     <<__Native("ZendCompat")>> public function save(string $path): inmixedt;
     <<__Native("ZendCompat")>> public function search(string $address): mixed;
+    <<__Native("ZendCompat")>> public function searchMany(array $addresses, bool $bitmap = false): mixed;
 }
@@ -5,6 +5,7 @@
 #include "config.h"
 #endif
 #include "php.h"
+#include <sys/inotify.h>
 
 #ifdef __cplusplus
 extern "C"
@@ -20,6 +21,9 @@ typedef struct
 {
     PREFIXDB *db;
     time_t   checked, modified;
+    ino_t    inode;
+    off_t    size;
+    int      watch, changed;
 } PREFIXDB_CACHE;
 KHASH_MAP_INIT_STR(PREFIXDB_HASH, PREFIXDB_CACHE *)
 
@@ -32,63 +36,72 @@ typedef struct
 
 khash_t(PREFIXDB_HASH) *prefixdb_cache;
 zend_class_entry *prefixdb_class_entry;
+int              prefixdb_notify = -1;
+pid_t            prefixdb_notify_pid;
+
+// databases are mapped read-only (MAP_SHARED) rather than copied, so that all the workers of a pool share the same page-cache
+// pages; databases listed in prefixdb.preload are mapped by the master process at startup and inherited by forked workers
+PHP_INI_BEGIN()
+    PHP_INI_ENTRY("prefixdb.preload",        "",   PHP_INI_SYSTEM, NULL)
+    PHP_INI_ENTRY("prefixdb.check_interval", "30", PHP_INI_SYSTEM, NULL)
+    PHP_INI_ENTRY("prefixdb.settle_delay",   "5",  PHP_INI_SYSTEM, NULL)
+PHP_INI_END()
+
+static PREFIXDB_CACHE *prefixdb_cache_load(const char *path TSRMLS_DC)
+{
+    PREFIXDB_CACHE *cache;
+    khiter_t       khit;
+    struct stat    info;
+    int            status;
+
+    if (!(cache = (PREFIXDB_CACHE *)calloc(1, sizeof(PREFIXDB_CACHE))))
+    {
+        return NULL;
+    }
+    if (!(cache->db = prefixdb_load_file(path, PREFIXDB_FLAGS_MMAP)))
+    {
+        php_error_docref(NULL TSRMLS_CC, E_WARNING, "cannot open or invalid PrefixDB database \"%s\"", path);
+        free(cache);
+        return NULL;
+    }
+    time(&cache->checked);
+    cache->modified = cache->checked;
+    cache->watch    = -1;
+    if (!stat(path, &info))
+    {
+        cache->modified = info.st_mtime;
+        cache->inode    = info.st_ino;
+        cache->size     = info.st_size;
+    }
+    if (prefixdb_notify >= 0 && prefixdb_notify_pid == getpid())
+    {
+        cache->watch = inotify_add_watch(prefixdb_notify, path, IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF);
+    }
+    khit = kh_put(PREFIXDB_HASH, prefixdb_cache, strdup(path), &status);
+    kh_value(prefixdb_cache, khit) = cache;
+    return cache;
+}
 
 PHP_METHOD(PrefixDB, __construct)
 {
     PREFIXDB_OBJECT *instance = (PREFIXDB_OBJECT *)zend_object_store_get_object(getThis() TSRMLS_CC);
     PREFIXDB_CACHE  *cache;
-    PREFIXDB        *pfdb;
     khiter_t        khit;
-    struct stat     info;
-    time_t          now;
     char            *path = NULL;
-    int             length = 0, status;
+    int             length = 0;
 
     if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "|s", &path, &length) == SUCCESS && length)
     {
         if ((khit = kh_get(PREFIXDB_HASH, prefixdb_cache, path)) != kh_end(prefixdb_cache))
         {
-            cache = kh_value(prefixdb_cache, khit);
-            time(&now);
-            if (now - cache->checked >= 30)
-            {
-                cache->checked = now;
-                if (!stat(path, &info) && info.st_mtime > cache->modified && info.st_mtime <= (now - 5))
-                {
-                    if ((pfdb = prefixdb_load_file(path, 0)))
-                    {
-                        prefixdb_free(&(cache->db));
-                        cache->db       = pfdb;
-                        cache->modified = info.st_mtime;
-                    }
-                    else
-                    {
-                        php_error_docref(NULL TSRMLS_CC, E_WARNING, "cannot open or invalid PrefixDB database \"%s\"", path);
-                    }
-                }
-            }
+            cache            = kh_value(prefixdb_cache, khit);
             instance->db     = cache->db;
             instance->cached = 1;
         }
-        else
+        else if ((cache = prefixdb_cache_load(path TSRMLS_CC)))
         {
-            if (!(instance->db = prefixdb_load_file(path, 0)))
-            {
-                php_error_docref(NULL TSRMLS_CC, E_WARNING, "cannot open or invalid PrefixDB database \"%s\"", path);
-            }
-            else if ((cache = (PREFIXDB_CACHE *)calloc(1, sizeof(PREFIXDB_CACHE))))
-            {
-                time(&cache->checked);
-                cache->modified  = cache->checked;
-                cache->db        = instance->db;
-                instance->cached = 1;
-                if (!stat(path, &info))
-                {
-                    cache->modified = info.st_mtime;
-                }
-                khit = kh_put(PREFIXDB_HASH, prefixdb_cache, strdup(path), &status);
-                kh_value(prefixdb_cache, khit) = cache;
-            }
+            instance->db     = cache->db;
+            instance->cached = 1;
         }
     }
     else if (!instance->db)
@@ -110,6 +123,65 @@ PHP_METHOD(PrefixDB, add)
     RETURN_LONG(PREFIXDB_ERROR_PARAM);
 }
 
+PHP_METHOD(PrefixDB, addBinary)
+{
+    PREFIXDB_OBJECT *instance = (PREFIXDB_OBJECT *)zend_object_store_get_object(getThis() TSRMLS_CC);
+    long            address   = 0, length = 0;
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "ll", &address, &length) == SUCCESS && !instance->cached)
+    {
+        RETURN_LONG(prefixdb_add_binary(instance->db, (uint32_t)address, length < 0 || length > 32 ? 0 : length, NULL));
+    }
+    RETURN_LONG(PREFIXDB_ERROR_PARAM);
+}
+
+// prefixes are parsed in place, only falling back to the slower (but more lenient) prefixdb_add_string() for unusual notations
+PHP_METHOD(PrefixDB, addMany)
+{
+    PREFIXDB_OBJECT *instance = (PREFIXDB_OBJECT *)zend_object_store_get_object(getThis() TSRMLS_CC);
+    zval            *input, **entry;
+    HashPosition    position;
+    uint32_t        address;
+    uint8_t         length;
+    int             status    = PREFIXDB_ERROR_OK;
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "a", &input) == FAILURE || instance->cached)
+    {
+        RETURN_LONG(PREFIXDB_ERROR_PARAM);
+    }
+    for (zend_hash_internal_pointer_reset_ex(Z_ARRVAL_P(input), &position);
+         status == PREFIXDB_ERROR_OK && zend_hash_get_current_data_ex(Z_ARRVAL_P(input), (void **)&entry, &position) == SUCCESS;
+         zend_hash_move_forward_ex(Z_ARRVAL_P(input), &position))
+    {
+        if (Z_TYPE_PP(entry) != IS_STRING)
+        {
+            status = PREFIXDB_ERROR_PARAM;
+        }
+        else if (prefixdb_parse_prefix(Z_STRVAL_PP(entry), Z_STRLEN_PP(entry), &address, &length) == Z_STRLEN_PP(entry))
+        {
+            status = prefixdb_add_binary(instance->db, address, length, NULL);
+        }
+        else
+        {
+            status = prefixdb_add_string(instance->db, Z_STRVAL_PP(entry), NULL);
+        }
+    }
+    RETURN_LONG(status);
+}
+
+PHP_METHOD(PrefixDB, addFile)
+{
+    PREFIXDB_OBJECT *instance = (PREFIXDB_OBJECT *)zend_object_store_get_object(getThis() TSRMLS_CC);
+    char            *path     = NULL;
+    int             length    = 0;
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "s", &path, &length) == SUCCESS && length && !instance->cached)
+    {
+        RETURN_LONG(prefixdb_add_file(instance->db, path));
+    }
+    RETURN_LONG(PREFIXDB_ERROR_PARAM);
+}
+
 PHP_METHOD(PrefixDB, save)
 {
     PREFIXDB_OBJECT *instance = (PREFIXDB_OBJECT *)zend_object_store_get_object(getThis() TSRMLS_CC);
@@ -139,6 +211,82 @@ PHP_METHOD(PrefixDB, search)
     RETURN_NULL();
 }
 
+// addresses may be dotted strings or integers (as returned by ip2long()), invalid ones never match; results are returned as
+// an array of booleans preserving the input keys, or as a bitmap string (bit n%8 of byte n/8 set when the n-th address matched)
+PHP_METHOD(PrefixDB, searchMany)
+{
+    PREFIXDB_OBJECT *instance = (PREFIXDB_OBJECT *)zend_object_store_get_object(getThis() TSRMLS_CC);
+    zval            *input, **entry;
+    HashPosition    position;
+    zend_bool       bitmap    = 0;
+    uint32_t        *addresses, count, index;
+    uint8_t         *results, *valid;
+    char            *key, *output;
+    uint            key_length;
+    ulong           key_index;
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "a|b", &input, &bitmap) == FAILURE || !instance->db)
+    {
+        RETURN_NULL();
+    }
+    count     = zend_hash_num_elements(Z_ARRVAL_P(input));
+    addresses = (uint32_t *)safe_emalloc(count + 1, sizeof(uint32_t), 0);
+    results   = (uint8_t *)emalloc(count + 1);
+    valid     = (uint8_t *)emalloc(count + 1);
+    for (index = 0, zend_hash_internal_pointer_reset_ex(Z_ARRVAL_P(input), &position);
+         zend_hash_get_current_data_ex(Z_ARRVAL_P(input), (void **)&entry, &position) == SUCCESS;
+         index ++, zend_hash_move_forward_ex(Z_ARRVAL_P(input), &position))
+    {
+        addresses[index] = 0;
+        valid[index]     = 0;
+        if (Z_TYPE_PP(entry) == IS_STRING)
+        {
+            valid[index] = prefixdb_parse_address(Z_STRVAL_PP(entry), Z_STRLEN_PP(entry), &(addresses[index])) == Z_STRLEN_PP(entry);
+        }
+        else if (Z_TYPE_PP(entry) == IS_LONG)
+        {
+            addresses[index] = (uint32_t)Z_LVAL_PP(entry);
+            valid[index]     = 1;
+        }
+    }
+    if (prefixdb_search_binary_batch(instance->db, addresses, count, results) != PREFIXDB_ERROR_OK)
+    {
+        memset(results, PREFIXDB_ERROR_NOTFOUND, count);
+    }
+    if (bitmap)
+    {
+        output = (char *)ecalloc(((count + 7) / 8) + 1, 1);
+        for (index = 0; index < count; index ++)
+        {
+            if (valid[index] && results[index] == PREFIXDB_ERROR_OK)
+            {
+                output[index / 8] |= 1 << (index % 8);
+            }
+        }
+        efree(addresses);
+        efree(results);
+        efree(valid);
+        RETURN_STRINGL(output, (count + 7) / 8, 0);
+    }
+    array_init_size(return_value, count);
+    for (index = 0, zend_hash_internal_pointer_reset_ex(Z_ARRVAL_P(input), &position);
+         index < count && zend_hash_get_current_data_ex(Z_ARRVAL_P(input), (void **)&entry, &position) == SUCCESS;
+         index ++, zend_hash_move_forward_ex(Z_ARRVAL_P(input), &position))
+    {
+        if (zend_hash_get_current_key_ex(Z_ARRVAL_P(input), &key, &key_length, &key_index, 0, &position) == HASH_KEY_IS_STRING)
+        {
+            add_assoc_bool_ex(return_value, key, key_length, valid[index] && results[index] == PREFIXDB_ERROR_OK);
+        }
+        else
+        {
+            add_index_bool(return_value, key_index, valid[index] && results[index] == PREFIXDB_ERROR_OK);
+        }
+    }
+    efree(addresses);
+    efree(results);
+    efree(valid);
+}
+
 static void prefixdb_dtor(PREFIXDB_OBJECT *instance TSRMLS_DC)
 {
     zend_object_std_dtor(&(instance->zo) TSRMLS_CC);
@@ -172,28 +320,147 @@ static zend_function_entry prefixdb_class_methods[] =
 {
     PHP_ME(PrefixDB, __construct, NULL, ZEND_ACC_PUBLIC | ZEND_ACC_CTOR)
     PHP_ME(PrefixDB, add,         NULL, ZEND_ACC_PUBLIC)
+    PHP_ME(PrefixDB, addBinary,   NULL, ZEND_ACC_PUBLIC)
+    PHP_ME(PrefixDB, addMany,     NULL, ZEND_ACC_PUBLIC)
+    PHP_ME(PrefixDB, addFile,     NULL, ZEND_ACC_PUBLIC)
     PHP_ME(PrefixDB, save,        NULL, ZEND_ACC_PUBLIC)
     PHP_ME(PrefixDB, search,      NULL, ZEND_ACC_PUBLIC)
+    PHP_ME(PrefixDB, searchMany,  NULL, ZEND_ACC_PUBLIC)
     {NULL, NULL, NULL}
 };
 
 PHP_MINIT_FUNCTION(prefixdb)
 {
     zend_class_entry class_entry;
+    char             *paths, *path, *state;
+
     INIT_CLASS_ENTRY(class_entry, "PrefixDB", prefixdb_class_methods);
     prefixdb_class_entry = zend_register_internal_class(&class_entry TSRMLS_CC);
     prefixdb_class_entry->create_object = prefixdb_ctor;
     prefixdb_cache = kh_init(PREFIXDB_HASH);
+    REGISTER_INI_ENTRIES();
+    if (*INI_STR("prefixdb.preload") && (paths = strdup(INI_STR("prefixdb.preload"))))
+    {
+        for (path = strtok_r(paths, ", ", &state); path; path = strtok_r(NULL, ", ", &state))
+        {
+            if (kh_get(PREFIXDB_HASH, prefixdb_cache, path) == kh_end(prefixdb_cache))
+            {
+                prefixdb_cache_load(path TSRMLS_CC);
+            }
+        }
+        free(paths);
+    }
     REGISTER_LONG_CONSTANT("PREFIXDB_ERROR_OK",       PREFIXDB_ERROR_OK,       CONST_CS | CONST_PERSISTENT);
     REGISTER_LONG_CONSTANT("PREFIXDB_ERROR_PARAM",    PREFIXDB_ERROR_PARAM,    CONST_CS | CONST_PERSISTENT);
     REGISTER_LONG_CONSTANT("PREFIXDB_ERROR_MEMORY",   PREFIXDB_ERROR_MEMORY,   CONST_CS | CONST_PERSISTENT);
     REGISTER_LONG_CONSTANT("PREFIXDB_ERROR_ACCESS",   PREFIXDB_ERROR_ACCESS,   CONST_CS | CONST_PERSISTENT);
     REGISTER_LONG_CONSTANT("PREFIXDB_ERROR_NOTFOUND", PREFIXDB_ERROR_NOTFOUND, CONST_CS | CONST_PERSISTENT);
+    REGISTER_LONG_CONSTANT("PREFIXDB_ERROR_CHECKSUM", PREFIXDB_ERROR_CHECKSUM, CONST_CS | CONST_PERSISTENT);
     REGISTER_LONG_CONSTANT("PREFIXDB_FLAGS_COPY",     PREFIXDB_FLAGS_COPY,     CONST_CS | CONST_PERSISTENT);
     REGISTER_LONG_CONSTANT("PREFIXDB_FLAGS_MMAP",     PREFIXDB_FLAGS_MMAP,     CONST_CS | CONST_PERSISTENT);
     return SUCCESS;
 }
 
+// inotify descriptors would be shared by all the workers forked from the master process (each event being consumed by only
+// one of them), so every process sets up its own and watches all the cached databases again
+static void prefixdb_notify_setup()
+{
+    khiter_t khit;
+
+    if (prefixdb_notify >= 0)
+    {
+        close(prefixdb_notify);
+    }
+    prefixdb_notify_pid = getpid();
+    prefixdb_notify     = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    for (khit = kh_begin(prefixdb_cache); khit != kh_end(prefixdb_cache); ++khit)
+    {
+        if (kh_exist(prefixdb_cache, khit))
+        {
+            kh_value(prefixdb_cache, khit)->watch = prefixdb_notify < 0 ? -1 :
+                inotify_add_watch(prefixdb_notify, kh_key(prefixdb_cache, khit), IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF);
+        }
+    }
+}
+
+// changed databases are reloaded once the request is over (all its PrefixDB objects being gone by then), so no request ever
+// waits for a reload or sees two versions of a database; files are watched with inotify, or checked every check_interval
+// seconds when it is not available, and only reloaded once they stayed untouched for settle_delay seconds
+PHP_RSHUTDOWN_FUNCTION(prefixdb)
+{
+    PREFIXDB_CACHE       *cache;
+    PREFIXDB             *pfdb;
+    struct inotify_event *event;
+    struct stat          info;
+    khiter_t             khit;
+    time_t               now;
+    ssize_t              bytes, offset;
+    char                 events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    if (prefixdb_notify_pid != getpid())
+    {
+        prefixdb_notify_setup();
+    }
+    while (prefixdb_notify >= 0 && (bytes = read(prefixdb_notify, events, sizeof(events))) > 0)
+    {
+        for (offset = 0; offset < bytes; offset += sizeof(struct inotify_event) + event->len)
+        {
+            event = (struct inotify_event *)(events + offset);
+            for (khit = kh_begin(prefixdb_cache); khit != kh_end(prefixdb_cache); ++khit)
+            {
+                if (kh_exist(prefixdb_cache, khit) && kh_value(prefixdb_cache, khit)->watch == event->wd)
+                {
+                    kh_value(prefixdb_cache, khit)->changed = 1;
+                }
+            }
+        }
+    }
+    time(&now);
+    for (khit = kh_begin(prefixdb_cache); khit != kh_end(prefixdb_cache); ++khit)
+    {
+        if (!kh_exist(prefixdb_cache, khit))
+        {
+            continue;
+        }
+        cache = kh_value(prefixdb_cache, khit);
+        if ((!cache->changed && (cache->watch >= 0 || now - cache->checked < INI_INT("prefixdb.check_interval"))) ||
+            stat(kh_key(prefixdb_cache, khit), &info) < 0)
+        {
+            continue;
+        }
+        cache->checked = now;
+        if (info.st_mtime == cache->modified && info.st_ino == cache->inode && info.st_size == cache->size)
+        {
+            cache->changed = 0;
+            continue;
+        }
+        if (info.st_mtime > now - INI_INT("prefixdb.settle_delay"))
+        {
+            cache->changed = 1;
+            continue;
+        }
+        cache->changed  = 0;
+        cache->modified = info.st_mtime;
+        cache->inode    = info.st_ino;
+        cache->size     = info.st_size;
+        if ((pfdb = prefixdb_load_file(kh_key(prefixdb_cache, khit), PREFIXDB_FLAGS_MMAP)))
+        {
+            prefixdb_free(&(cache->db));
+            cache->db = pfdb;
+        }
+        else
+        {
+            php_error_docref(NULL TSRMLS_CC, E_WARNING, "cannot open or invalid PrefixDB database \"%s\"", kh_key(prefixdb_cache, khit));
+        }
+        if (cache->watch >= 0)
+        {
+            inotify_rm_watch(prefixdb_notify, cache->watch);
+            cache->watch = inotify_add_watch(prefixdb_notify, kh_key(prefixdb_cache, khit), IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF);
+        }
+    }
+    return SUCCESS;
+}
+
 PHP_MSHUTDOWN_FUNCTION(prefixdb)
 {
     khiter_t khit;
@@ -208,6 +475,11 @@ PHP_MSHUTDOWN_FUNCTION(prefixdb)
         }
     }
     kh_destroy(PREFIXDB_HASH, prefixdb_cache);
+    if (prefixdb_notify >= 0 && prefixdb_notify_pid == getpid())
+    {
+        close(prefixdb_notify);
+    }
+    UNREGISTER_INI_ENTRIES();
     return SUCCESS;
 }
 
@@ -219,7 +491,7 @@ zend_module_entry prefixdb_module_entry =
     PHP_MINIT(prefixdb),
     PHP_MSHUTDOWN(prefixdb),
     NULL,
-    NULL,
+    PHP_RSHUTDOWN(prefixdb),
     NULL,
     "1.1",
     STANDARD_MODULE_PROPERTIES
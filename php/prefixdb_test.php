@@ -30,6 +30,41 @@ $begin = microtime(true); $status = $pfdb->save('/tmp/bench.pfdb'); $end = micro
 print sprintf("save database             %s [%.06fs]\n", $status == PREFIXDB_ERROR_OK ? 'pass' : 'fail', $end - $begin);
 $exit |= ($status != PREFIXDB_ERROR_OK ? 1 : 0);
 
+$prefixes = array();
+for ($count = 0; $count < PREFIXES_COUNT; $count ++)
+{
+    $prefixes[] = sprintf('%d.%d.%d.%d/%d', rand(1, 223), rand(1, 223), rand(1, 223), rand(1, 223), rand(16, 28));
+}
+file_put_contents('/tmp/bench.txt', implode("\n", $prefixes) . "\n");
+$begin  = microtime(true); $many = new PrefixDB(); $status = $many->addMany($prefixes); $end = microtime(true);
+$status = $status == PREFIXDB_ERROR_OK && $many->save('/tmp/bench-many.pfdb') == PREFIXDB_ERROR_OK;
+print sprintf("add %6d prefixes (many)%s [%.06fs] [%d prefixes/s]\n", PREFIXES_COUNT, $status ? 'pass' : 'fail', $end - $begin, PREFIXES_COUNT / ($end - $begin));
+$exit |= ($status ? 0 : 1);
+$begin  = microtime(true); $file = new PrefixDB(); $status = $file->addFile('/tmp/bench.txt'); $end = microtime(true);
+$status = $status == PREFIXDB_ERROR_OK && $file->save('/tmp/bench-file.pfdb') == PREFIXDB_ERROR_OK &&
+          md5_file('/tmp/bench-file.pfdb') == md5_file('/tmp/bench-many.pfdb');
+print sprintf("add %6d prefixes (file)%s [%.06fs] [%d prefixes/s]\n", PREFIXES_COUNT, $status ? 'pass' : 'fail', $end - $begin, PREFIXES_COUNT / ($end - $begin));
+$exit |= ($status ? 0 : 1);
+$binaries = array();
+foreach ($prefixes as $prefix)
+{
+    list($address, $length) = explode('/', $prefix);
+    $binaries[] = array(ip2long($address), (int)$length);
+}
+$begin  = microtime(true); $binary = new PrefixDB(); $status = PREFIXDB_ERROR_OK;
+foreach ($binaries as $entry)
+{
+    $status |= $binary->addBinary($entry[0], $entry[1]);
+}
+$end    = microtime(true);
+$status = $status == PREFIXDB_ERROR_OK &&
+          $binary->addBinary(ip2long('10.0.0.0'), 33) == PREFIXDB_ERROR_PARAM && $binary->addBinary(ip2long('10.0.0.0'), -1) == PREFIXDB_ERROR_PARAM &&
+          $binary->save('/tmp/bench-binary.pfdb') == PREFIXDB_ERROR_OK && md5_file('/tmp/bench-binary.pfdb') == md5_file('/tmp/bench-many.pfdb');
+print sprintf("add %6d prefixes (bin) %s [%.06fs] [%d prefixes/s]\n", PREFIXES_COUNT, $status ? 'pass' : 'fail', $end - $begin, PREFIXES_COUNT / ($end - $begin));
+$exit |= ($status ? 0 : 1);
+unset($many, $file, $binary, $binaries);
+unlink('/tmp/bench.txt'); unlink('/tmp/bench-many.pfdb'); unlink('/tmp/bench-file.pfdb'); unlink('/tmp/bench-binary.pfdb');
+
 $begin = microtime(true); $pfdb = new PrefixDB('/tmp/bench.pfdb'); $end = microtime(true);
 printf("load database             pass [%.06fs]\n", $end - $begin);
 
@@ -54,5 +89,37 @@ print sprintf("\rsearch %6d addresses   pass [%.06fs] [%d searches/s - %d matche
               SEARCHES_COUNT, $end - $begin, SEARCHES_COUNT / ($end - $begin), $matches[0], $matches[1]);
 for ($count = 0; $count < SEARCHES_COUNT / 25000; $count ++) print ' '; print "\n";
 
+$addresses = array();
+for ($count = 0; $count < SEARCHES_COUNT; $count ++)
+{
+    $addresses[] = sprintf('%d.%d.%d.%d', rand(1, 254), rand(1, 254), rand(1, 254), rand(1, 254));
+}
+$begin   = microtime(true);
+$matches = 0;
+foreach ($addresses as $address)
+{
+    if ($pfdb->search($address) !== null) $matches ++;
+}
+$end     = microtime(true);
+$elapsed = $end - $begin;
+print sprintf("search %6d (loop)      pass [%.06fs] [%d searches/s - %d matched]\n", SEARCHES_COUNT, $elapsed, SEARCHES_COUNT / $elapsed, $matches);
+
+$begin   = microtime(true); $results = $pfdb->searchMany($addresses); $end = microtime(true);
+$status  = is_array($results) && count($results) == SEARCHES_COUNT && count(array_filter($results)) == $matches;
+print sprintf("search %6d (many)      %s [%.06fs] [%d searches/s - %.1fx loop]\n", SEARCHES_COUNT,
+              $status ? 'pass' : 'fail', $end - $begin, SEARCHES_COUNT / ($end - $begin), $elapsed / ($end - $begin));
+$exit |= ($status ? 0 : 1);
+
+$begin   = microtime(true); $results = $pfdb->searchMany($addresses, true); $end = microtime(true);
+$count   = 0;
+for ($index = 0; is_string($results) && $index < strlen($results); $index ++)
+{
+    $count += substr_count(decbin(ord($results[$index])), '1');
+}
+$status  = is_string($results) && strlen($results) == (int)((SEARCHES_COUNT + 7) / 8) && $count == $matches;
+print sprintf("search %6d (bitmap)    %s [%.06fs] [%d searches/s - %.1fx loop]\n", SEARCHES_COUNT,
+              $status ? 'pass' : 'fail', $end - $begin, SEARCHES_COUNT / ($end - $begin), $elapsed / ($end - $begin));
+$exit |= ($status ? 0 : 1);
+
 unlink('/tmp/bench.pfdb');
 exit($exit);